@@ -0,0 +1,380 @@
+/*
+ * apex_batch.c
+ * Contains the batch front end which simulates many programs in parallel on
+ * a work-stealing thread pool
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_batch.h"
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+enum
+{
+    JOB_PENDING,
+    JOB_HALTED,      /* HALT retired */
+    JOB_CYCLE_LIMIT, /* Ran out of cycles before HALT */
+    JOB_LOAD_ERROR   /* Input file could not be loaded */
+};
+
+static const char *const job_status_str[] = {
+    "pending", "halted", "cycle_limit", "load_error",
+};
+
+/* One simulation job and its result */
+typedef struct Batch_Job
+{
+    char *filename;
+    int cycles;
+    int status;
+    int clock;
+    int insn_completed;
+    int pc;
+} Batch_Job;
+
+/* Per-worker queue of job indices. The owner takes jobs from the tail,
+ * idle workers steal from the head. */
+typedef struct Work_Deque
+{
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} Work_Deque;
+
+typedef struct Batch_Pool
+{
+    Batch_Job *jobs;
+    Work_Deque *deques;
+    int num_workers;
+} Batch_Pool;
+
+typedef struct Batch_Worker
+{
+    Batch_Pool *pool;
+    int id;
+} Batch_Worker;
+
+static int
+take_own_job(Work_Deque *deque)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail)
+    {
+        job = --deque->tail;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+static int
+steal_job(Work_Deque *deque)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail)
+    {
+        job = deque->head++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+static void
+run_job(Batch_Job *job)
+{
+    APEX_Config config;
+    APEX_CPU *cpu;
+
+    APEX_config_init(&config);
+    config.max_cycles = job->cycles;
+    config.trace = FALSE;
+    config.display = FALSE;
+    config.skip_idle = TRUE;
+
+    cpu = APEX_cpu_create(job->filename, &config);
+    if (!cpu)
+    {
+        job->status = JOB_LOAD_ERROR;
+        return;
+    }
+
+    APEX_cpu_run(cpu);
+
+    job->status = cpu->halted ? JOB_HALTED : JOB_CYCLE_LIMIT;
+    job->clock = cpu->halted ? cpu->clock : cpu->clock - 1;
+    job->insn_completed = cpu->insn_completed;
+    job->pc = cpu->pc;
+    APEX_cpu_stop(cpu);
+}
+
+static void *
+worker_main(void *arg)
+{
+    Batch_Worker *worker = arg;
+    Batch_Pool *pool = worker->pool;
+    int job;
+
+    for (;;)
+    {
+        job = take_own_job(&pool->deques[worker->id]);
+
+        /* Own queue is empty, try the others starting with the next one.
+         * No jobs are added while running, so when every queue is empty
+         * the worker is done. */
+        for (int i = 1; job < 0 && i < pool->num_workers; ++i)
+        {
+            job = steal_job(&pool->deques[(worker->id + i) % pool->num_workers]);
+        }
+
+        if (job < 0)
+        {
+            break;
+        }
+        run_job(&pool->jobs[job]);
+    }
+    return NULL;
+}
+
+static void
+free_jobs(Batch_Job *jobs, int num_jobs)
+{
+    for (int i = 0; i < num_jobs; ++i)
+    {
+        free(jobs[i].filename);
+    }
+    free(jobs);
+}
+
+/* Returns NULL if the manifest can not be read in full or has no jobs */
+static Batch_Job *
+read_manifest(const char *manifest, int *num_jobs)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    Batch_Job *jobs = NULL;
+    int capacity = 0;
+    int count = 0;
+    int ok = TRUE;
+
+    fp = fopen(manifest, "r");
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    while (getline(&line, &len, fp) != -1)
+    {
+        char filename[4096];
+        int cycles;
+
+        if (sscanf(line, " %4095s %d", filename, &cycles) != 2 || filename[0] == '#')
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            Batch_Job *grown;
+
+            capacity = capacity ? capacity * 2 : 64;
+            grown = realloc(jobs, capacity * sizeof(*jobs));
+            if (!grown)
+            {
+                ok = FALSE;
+                break;
+            }
+            jobs = grown;
+        }
+
+        memset(&jobs[count], 0, sizeof(jobs[count]));
+        jobs[count].filename = strdup(filename);
+        if (!jobs[count].filename)
+        {
+            ok = FALSE;
+            break;
+        }
+        jobs[count].cycles = cycles;
+        count++;
+    }
+
+    free(line);
+    fclose(fp);
+    if (!ok || !count)
+    {
+        free_jobs(jobs, count);
+        return NULL;
+    }
+
+    *num_jobs = count;
+    return jobs;
+}
+
+/*
+ * Runs every job of the pool on 'num_threads' workers, worker 0 on the calling
+ * thread. Returns -1 if there is no memory for the workers.
+ */
+static int
+run_workers(Batch_Pool *pool, int num_jobs, int num_threads)
+{
+    Batch_Worker *workers;
+    pthread_t *threads;
+    int *started;
+    int ret = -1;
+
+    /* Deal the jobs out in contiguous blocks, stealing evens out the rest */
+    pool->num_workers = num_threads;
+    pool->deques = calloc(num_threads, sizeof(*pool->deques));
+    workers = calloc(num_threads, sizeof(*workers));
+    threads = calloc(num_threads, sizeof(*threads));
+    started = calloc(num_threads, sizeof(*started));
+    if (pool->deques && workers && threads && started)
+    {
+        for (int i = 0; i < num_threads; ++i)
+        {
+            pthread_mutex_init(&pool->deques[i].lock, NULL);
+            pool->deques[i].head = (int)((long)num_jobs * i / num_threads);
+            pool->deques[i].tail = (int)((long)num_jobs * (i + 1) / num_threads);
+            workers[i].pool = pool;
+            workers[i].id = i;
+        }
+
+        /* The jobs dealt to a worker whose thread failed to start are stolen
+         * by the others */
+        for (int i = 1; i < num_threads; ++i)
+        {
+            started[i] = pthread_create(&threads[i], NULL, worker_main, &workers[i]) == 0;
+        }
+
+        worker_main(&workers[0]);
+
+        /* Idle workers may still steal from any queue until they are joined */
+        for (int i = 1; i < num_threads; ++i)
+        {
+            if (started[i])
+            {
+                pthread_join(threads[i], NULL);
+            }
+        }
+
+        for (int i = 0; i < num_threads; ++i)
+        {
+            pthread_mutex_destroy(&pool->deques[i].lock);
+        }
+        ret = 0;
+    }
+
+    free(pool->deques);
+    free(workers);
+    free(threads);
+    free(started);
+    return ret;
+}
+
+/* Writes 'field' as a CSV field, quoted if it holds a comma or a quote.
+ * Returns a negative value on a write error. */
+static int
+write_csv_field(FILE *out, const char *field)
+{
+    if (!strpbrk(field, ",\"\r\n"))
+    {
+        return fputs(field, out);
+    }
+
+    if (fputc('"', out) == EOF)
+    {
+        return -1;
+    }
+    for (const char *c = field; *c; ++c)
+    {
+        if ((*c == '"' && fputc('"', out) == EOF) || fputc(*c, out) == EOF)
+        {
+            return -1;
+        }
+    }
+    return fputc('"', out) == EOF ? -1 : 0;
+}
+
+/* Returns -1 if a result record could not be written */
+static int
+write_results(FILE *out, const Batch_Job *jobs, int num_jobs)
+{
+    if (fprintf(out, "job,input_file,status,cycles,instructions,pc\n") < 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < num_jobs; ++i)
+    {
+        const Batch_Job *job = &jobs[i];
+
+        if (fprintf(out, "%d,", i) < 0 || write_csv_field(out, job->filename) < 0
+            || fprintf(out, ",%s,%d,%d,%d\n", job_status_str[job->status],
+                       job->clock, job->insn_completed, job->pc) < 0)
+        {
+            return -1;
+        }
+    }
+    return fflush(out) || ferror(out) ? -1 : 0;
+}
+
+int
+APEX_batch_run(const char *manifest, int num_threads, const char *output)
+{
+    Batch_Pool pool;
+    FILE *out;
+    int num_jobs = 0;
+    int ret;
+
+    /* Read the manifest first, so that a bad one leaves the output alone */
+    pool.jobs = read_manifest(manifest, &num_jobs);
+    if (!pool.jobs)
+    {
+        return -1;
+    }
+
+    /* Fail on the output before spending the time to run the jobs */
+    out = output ? fopen(output, "w") : stdout;
+    if (!out)
+    {
+        free_jobs(pool.jobs, num_jobs);
+        return -2;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads > num_jobs)
+    {
+        num_threads = num_jobs;
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    ret = run_workers(&pool, num_jobs, num_threads);
+    if (ret == 0 && write_results(out, pool.jobs, num_jobs))
+    {
+        ret = -2;
+    }
+
+    if (out != stdout && fclose(out) && ret == 0)
+    {
+        ret = -2;
+    }
+    free_jobs(pool.jobs, num_jobs);
+    return ret;
+}
@@ -0,0 +1,29 @@
+/*
+ * apex_batch.h
+ * Contains the batch front end which simulates many programs in parallel
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BATCH_H_
+#define _APEX_BATCH_H_
+
+/*
+ * Simulates every job of 'manifest' on its own APEX_CPU using 'num_threads'
+ * worker threads (0 for one per online core), and writes one CSV result
+ * record per job, in manifest order, to 'output' (NULL for stdout).
+ *
+ * Manifest format, one job per line, blank lines and '#' comments ignored:
+ *   <input_file> <cycles>
+ *
+ * Input file names holding a comma or a quote are quoted as in RFC 4180.
+ *
+ * Returns 0 if every job was run and its record written, -1 if the manifest
+ * can not be read, has no jobs or there is no memory, and -2 if the output
+ * can not be written. The output is opened only after the manifest has been
+ * read, and before any job runs.
+ */
+int APEX_batch_run(const char *manifest, int num_threads, const char *output);
+
+#endif
@@ -0,0 +1,266 @@
+/*
+ * apex_bench.c
+ * Contains the host throughput benchmark of the simulator
+ *
+ * Runs each kernel a number of times on a fresh cpu without tracing and
+ * reports how fast the simulator itself is, not how fast the simulated
+ * program is.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+
+/* Result of one kernel */
+typedef struct Bench_Result
+{
+    const char *kernel;
+    int cycles;
+    int instructions;
+    double median_seconds;
+    double min_seconds;
+} Bench_Result;
+
+static int
+compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Runs 'kernel' once and returns the host seconds spent in APEX_cpu_run(), or
+ * a negative value if it can not be loaded or does not HALT. Kernels start
+ * with "MOVC R15,#<iterations>", 'iterations' replaces that count when it is
+ * positive.
+ */
+static double
+run_kernel(const char *kernel, int iterations, int *cycles, int *instructions)
+{
+    struct timespec start, end;
+    APEX_Config config;
+    APEX_CPU *cpu;
+    int halted;
+
+    APEX_config_init(&config);
+    config.trace = FALSE;
+    config.display = FALSE;
+    config.single_step = FALSE;
+
+    cpu = APEX_cpu_create(kernel, &config);
+    if (!cpu)
+    {
+        return -1.0;
+    }
+
+    if (iterations > 0 && cpu->code_memory[0].opcode == OPCODE_MOVC)
+    {
+        cpu->code_memory[0].imm = iterations;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    APEX_cpu_run(cpu);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *cycles = cpu->clock;
+    *instructions = cpu->insn_completed;
+    halted = cpu->halted;
+    APEX_cpu_stop(cpu);
+
+    if (!halted)
+    {
+        return -1.0;
+    }
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int
+bench_kernel(Bench_Result *result, int iterations, int warmup, int reps)
+{
+    double *seconds = calloc(reps, sizeof(*seconds));
+
+    if (!seconds)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < warmup + reps; ++i)
+    {
+        double t = run_kernel(result->kernel, iterations, &result->cycles,
+                              &result->instructions);
+
+        if (t < 0)
+        {
+            free(seconds);
+            return -1;
+        }
+
+        if (i >= warmup)
+        {
+            seconds[i - warmup] = t;
+        }
+    }
+
+    qsort(seconds, reps, sizeof(*seconds), compare_double);
+    result->min_seconds = seconds[0];
+    result->median_seconds = (reps % 2) ? seconds[reps / 2]
+                                        : (seconds[reps / 2 - 1] + seconds[reps / 2]) / 2;
+    free(seconds);
+    return 0;
+}
+
+static double
+per_second(int count, double seconds)
+{
+    return seconds > 0 ? count / seconds : 0.0;
+}
+
+static void
+write_csv(FILE *out, const Bench_Result *results, int count)
+{
+    fprintf(out, "kernel,cycles,instructions,median_s,min_s,cycles_per_s,insns_per_s,ns_per_cycle\n");
+    for (int i = 0; i < count; ++i)
+    {
+        const Bench_Result *r = &results[i];
+
+        fprintf(out, "%s,%d,%d,%.9f,%.9f,%.0f,%.0f,%.3f\n", r->kernel, r->cycles,
+                r->instructions, r->median_seconds, r->min_seconds,
+                per_second(r->cycles, r->median_seconds),
+                per_second(r->instructions, r->median_seconds),
+                r->cycles ? r->median_seconds * 1e9 / r->cycles : 0.0);
+    }
+}
+
+static void
+write_json(FILE *out, const Bench_Result *results, int count)
+{
+    fprintf(out, "[\n");
+    for (int i = 0; i < count; ++i)
+    {
+        const Bench_Result *r = &results[i];
+
+        fprintf(out,
+                "  {\"kernel\": \"%s\", \"cycles\": %d, \"instructions\": %d, "
+                "\"median_s\": %.9f, \"min_s\": %.9f, \"cycles_per_s\": %.0f, "
+                "\"insns_per_s\": %.0f, \"ns_per_cycle\": %.3f}%s\n",
+                r->kernel, r->cycles, r->instructions, r->median_seconds, r->min_seconds,
+                per_second(r->cycles, r->median_seconds),
+                per_second(r->instructions, r->median_seconds),
+                r->cycles ? r->median_seconds * 1e9 / r->cycles : 0.0,
+                (i + 1 < count) ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+static int
+write_file(const char *filename, const Bench_Result *results, int count,
+           void (*writer)(FILE *, const Bench_Result *, int))
+{
+    FILE *out = fopen(filename, "w");
+
+    if (!out)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", filename);
+        return -1;
+    }
+
+    writer(out, results, count);
+    fclose(out);
+    return 0;
+}
+
+int
+main(int argc, char const *argv[])
+{
+    const char *csv = NULL;
+    const char *json = NULL;
+    int iterations = 0;
+    int warmup = 1;
+    int reps = 5;
+    int num_kernels = 0;
+    int status = 0;
+    Bench_Result *results;
+
+    results = calloc(argc, sizeof(*results));
+    if (!results)
+    {
+        return 1;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            warmup = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc)
+        {
+            reps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+        {
+            csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            json = argv[++i];
+        }
+        else
+        {
+            results[num_kernels++].kernel = argv[i];
+        }
+    }
+
+    if (!num_kernels || reps < 1 || warmup < 0)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s [--iterations <n>] [--warmup <runs>] [--reps <runs>]\n", argv[0]);
+        fprintf(stderr, "APEX_Help:        [--csv <file>] [--json <file>] <kernel.asm>...\n");
+        free(results);
+        return 1;
+    }
+
+    printf("%-24s %12s %12s %10s %10s %10s\n", "kernel", "cycles", "insns", "Mcycles/s",
+           "Minsns/s", "ns/cycle");
+
+    for (int i = 0; i < num_kernels; ++i)
+    {
+        Bench_Result *r = &results[i];
+
+        if (bench_kernel(r, iterations, warmup, reps))
+        {
+            fprintf(stderr, "APEX_Error: Kernel %s did not load or did not HALT\n", r->kernel);
+            status = 1;
+            continue;
+        }
+
+        printf("%-24s %12d %12d %10.2f %10.2f %10.3f\n", r->kernel, r->cycles, r->instructions,
+               per_second(r->cycles, r->median_seconds) / 1e6,
+               per_second(r->instructions, r->median_seconds) / 1e6,
+               r->cycles ? r->median_seconds * 1e9 / r->cycles : 0.0);
+    }
+
+    if (!status && csv && write_file(csv, results, num_kernels, write_csv))
+    {
+        status = 1;
+    }
+
+    if (!status && json && write_file(json, results, num_kernels, write_json))
+    {
+        status = 1;
+    }
+
+    free(results);
+    return status;
+}
@@ -0,0 +1,147 @@
+/*
+ * apex_btb.c
+ * Contains the Branch Target Buffer consulted by the Fetch stage
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_btb.h"
+#include "apex_macros.h"
+
+int
+APEX_btb_init(APEX_BTB *btb, int entries, int ways)
+{
+    memset(btb, 0, sizeof(*btb));
+
+    if (entries == 0)
+    {
+        return 0;
+    }
+
+    if (entries < 0 || ways <= 0 || entries % ways)
+    {
+        return -1;
+    }
+
+    btb->entries = calloc(entries, sizeof(*btb->entries));
+    if (!btb->entries)
+    {
+        return -1;
+    }
+
+    btb->num_sets = entries / ways;
+    btb->ways = ways;
+    return 0;
+}
+
+void
+APEX_btb_free(APEX_BTB *btb)
+{
+    free(btb->entries);
+    btb->entries = NULL;
+}
+
+static APEX_BTB_Entry *
+btb_set(APEX_BTB *btb, int pc)
+{
+    return &btb->entries[((unsigned)pc / 4 % btb->num_sets) * btb->ways];
+}
+
+static APEX_BTB_Entry *
+btb_find(APEX_BTB *btb, int pc)
+{
+    APEX_BTB_Entry *set = btb_set(btb, pc);
+
+    for (int i = 0; i < btb->ways; ++i)
+    {
+        if (set[i].valid && set[i].pc == pc)
+        {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+int
+APEX_btb_predict(APEX_BTB *btb, int pc)
+{
+    APEX_BTB_Entry *entry;
+
+    if (!btb->entries)
+    {
+        return pc + 4;
+    }
+
+    btb->lookups++;
+    entry = btb_find(btb, pc);
+    if (!entry)
+    {
+        return pc + 4;
+    }
+
+    btb->hits++;
+    entry->last_use = ++btb->use_clock;
+    return (entry->counter >= 2) ? entry->target : pc + 4;
+}
+
+void
+APEX_btb_update(APEX_BTB *btb, int pc, int taken, int target)
+{
+    APEX_BTB_Entry *entry;
+    APEX_BTB_Entry *set;
+
+    if (!btb->entries)
+    {
+        return;
+    }
+
+    entry = btb_find(btb, pc);
+    if (!entry)
+    {
+        /* Only taken control instructions are worth an entry */
+        if (!taken)
+        {
+            return;
+        }
+
+        set = btb_set(btb, pc);
+        entry = &set[0];
+        for (int i = 0; i < btb->ways; ++i)
+        {
+            if (!set[i].valid)
+            {
+                entry = &set[i];
+                break;
+            }
+
+            if (set[i].last_use < entry->last_use)
+            {
+                entry = &set[i];
+            }
+        }
+
+        entry->valid = TRUE;
+        entry->pc = pc;
+        entry->counter = 2;
+        entry->target = target;
+        entry->last_use = ++btb->use_clock;
+        return;
+    }
+
+    if (taken)
+    {
+        entry->target = target;
+        if (entry->counter < 3)
+        {
+            entry->counter++;
+        }
+    }
+    else if (entry->counter > 0)
+    {
+        entry->counter--;
+    }
+}
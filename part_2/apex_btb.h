@@ -0,0 +1,54 @@
+/*
+ * apex_btb.h
+ * Contains the Branch Target Buffer consulted by the Fetch stage
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BTB_H_
+#define _APEX_BTB_H_
+
+#include <stdint.h>
+
+/* One BTB entry, tagged with the full pc of the control instruction */
+typedef struct APEX_BTB_Entry
+{
+    int valid;
+    int pc;
+    int target;
+    uint8_t counter;   /* 2-bit saturating counter, >= 2 predicts taken */
+    uint32_t last_use; /* For LRU replacement within a set */
+} APEX_BTB_Entry;
+
+/* Set-associative BTB with 2-bit counters. With no entries it predicts
+ * not-taken for everything, which is the pipeline without a BTB, while the
+ * mispredict and flush counters still count every redirect from EX. */
+typedef struct APEX_BTB
+{
+    int num_sets;
+    int ways;
+    APEX_BTB_Entry *entries;
+    uint32_t use_clock;
+
+    /* Statistics */
+    uint64_t lookups;      /* Fetches that consulted the BTB */
+    uint64_t hits;         /* Lookups that found an entry */
+    uint64_t resolved;     /* Control instructions resolved in EX */
+    uint64_t mispredicts;  /* Resolved with a different next pc than fetched */
+    uint64_t flush_cycles; /* Fetch cycles lost to mispredict flushes */
+} APEX_BTB;
+
+/* Returns 0 on success, -1 if 'entries' is not a multiple of 'ways' or the
+ * table can not be allocated. 'entries' of 0 disables the BTB. */
+int APEX_btb_init(APEX_BTB *btb, int entries, int ways);
+void APEX_btb_free(APEX_BTB *btb);
+
+/* Returns the predicted next fetch pc after the instruction at 'pc' */
+int APEX_btb_predict(APEX_BTB *btb, int pc);
+
+/* Trains the BTB with the resolved outcome of the control instruction at
+ * 'pc' */
+void APEX_btb_update(APEX_BTB *btb, int pc, int taken, int target);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * apex_cache.c
+ * Contains the set-associative cache timing model
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+/* Parses a whole non-negative decimal number into 'number', returns -1 if
+ * 'value' is anything else or does not fit in an int */
+static int
+parse_number(const char *value, int *number)
+{
+    char *end;
+    long parsed;
+
+    errno = 0;
+    parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno || parsed < 0 || parsed > INT_MAX)
+    {
+        return -1;
+    }
+    *number = (int)parsed;
+    return 0;
+}
+
+static int
+is_power_of_two(int value)
+{
+    return value > 0 && !(value & (value - 1));
+}
+
+void
+APEX_cache_config_init(APEX_Cache_Config *config)
+{
+    config->size = 0;
+    config->line_size = 32;
+    config->ways = 2;
+    config->replacement = CACHE_LRU;
+    config->write_back = TRUE;
+    config->hit_latency = 1;
+    config->miss_latency = 10;
+}
+
+int
+APEX_cache_config_parse(APEX_Cache_Config *config, const char *spec)
+{
+    char *copy = strdup(spec);
+    char *saveptr;
+    int ret = 0;
+
+    if (!copy)
+    {
+        return -1;
+    }
+
+    /* Enabling the cache without giving a size uses the default size */
+    config->size = 4096;
+
+    for (char *token = strtok_r(copy, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr))
+    {
+        char *value = strchr(token, '=');
+
+        if (!value)
+        {
+            ret = -1;
+            break;
+        }
+        *value++ = '\0';
+
+        if (strcmp(token, "size") == 0)
+        {
+            if (parse_number(value, &config->size))
+            {
+                ret = -1;
+                break;
+            }
+        }
+        else if (strcmp(token, "line") == 0)
+        {
+            if (parse_number(value, &config->line_size))
+            {
+                ret = -1;
+                break;
+            }
+        }
+        else if (strcmp(token, "ways") == 0)
+        {
+            if (parse_number(value, &config->ways))
+            {
+                ret = -1;
+                break;
+            }
+        }
+        else if (strcmp(token, "repl") == 0 && strcmp(value, "lru") == 0)
+        {
+            config->replacement = CACHE_LRU;
+        }
+        else if (strcmp(token, "repl") == 0 && strcmp(value, "plru") == 0)
+        {
+            config->replacement = CACHE_PLRU;
+        }
+        else if (strcmp(token, "write") == 0 && strcmp(value, "wb") == 0)
+        {
+            config->write_back = TRUE;
+        }
+        else if (strcmp(token, "write") == 0 && strcmp(value, "wt") == 0)
+        {
+            config->write_back = FALSE;
+        }
+        else if (strcmp(token, "hit") == 0)
+        {
+            if (parse_number(value, &config->hit_latency))
+            {
+                ret = -1;
+                break;
+            }
+        }
+        else if (strcmp(token, "miss") == 0)
+        {
+            if (parse_number(value, &config->miss_latency))
+            {
+                ret = -1;
+                break;
+            }
+        }
+        else
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    free(copy);
+    return ret;
+}
+
+int
+APEX_cache_init(APEX_Cache *cache, const APEX_Cache_Config *config)
+{
+    int lines;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->config = *config;
+
+    if (config->size == 0)
+    {
+        return 0;
+    }
+
+    /* Lines hold whole words, sets are indexed with address bits */
+    if (config->size < 0 || config->line_size < 4 || !is_power_of_two(config->line_size)
+        || config->ways <= 0 || config->size % (config->line_size * config->ways)
+        || !is_power_of_two(config->size / (config->line_size * config->ways))
+        || config->hit_latency < 1 || config->miss_latency < config->hit_latency
+        || config->miss_latency > UINT16_MAX + 1
+        || (config->replacement == CACHE_PLRU
+            && (!is_power_of_two(config->ways) || config->ways > 64)))
+    {
+        return -1;
+    }
+
+    lines = config->size / config->line_size;
+    cache->num_sets = lines / config->ways;
+    cache->line_shift = __builtin_ctz(config->line_size);
+    cache->lines = calloc(lines, sizeof(*cache->lines));
+    cache->plru = calloc(cache->num_sets, sizeof(*cache->plru));
+
+    if (!cache->lines || !cache->plru)
+    {
+        APEX_cache_free(cache);
+        return -1;
+    }
+    return 0;
+}
+
+void
+APEX_cache_free(APEX_Cache *cache)
+{
+    free(cache->lines);
+    free(cache->plru);
+    cache->lines = NULL;
+    cache->plru = NULL;
+}
+
+/*
+ * Points the tree bits of 'set' away from 'way', which was just used
+ */
+static void
+plru_touch(APEX_Cache *cache, int set, int way)
+{
+    int levels = __builtin_ctz(cache->config.ways);
+    int node = 0;
+
+    for (int level = levels - 1; level >= 0; --level)
+    {
+        int bit = (way >> level) & 1;
+
+        if (bit)
+        {
+            cache->plru[set] &= ~(1ULL << node);
+        }
+        else
+        {
+            cache->plru[set] |= 1ULL << node;
+        }
+        node = 2 * node + 1 + bit;
+    }
+}
+
+/*
+ * Follows the tree bits of 'set' to the pseudo least recently used way
+ */
+static int
+plru_victim(const APEX_Cache *cache, int set)
+{
+    int levels = __builtin_ctz(cache->config.ways);
+    int node = 0;
+    int way = 0;
+
+    for (int level = 0; level < levels; ++level)
+    {
+        int bit = (cache->plru[set] >> node) & 1;
+
+        way = (way << 1) | bit;
+        node = 2 * node + 1 + bit;
+    }
+    return way;
+}
+
+static void
+touch_line(APEX_Cache *cache, int set, int way)
+{
+    if (cache->config.replacement == CACHE_PLRU)
+    {
+        plru_touch(cache, set, way);
+    }
+    else
+    {
+        cache->lines[set * cache->config.ways + way].last_use = ++cache->use_clock;
+    }
+}
+
+static int
+choose_victim(const APEX_Cache *cache, int set)
+{
+    const APEX_Cache_Line *lines = &cache->lines[set * cache->config.ways];
+    int victim = 0;
+
+    for (int i = 0; i < cache->config.ways; ++i)
+    {
+        if (!lines[i].valid)
+        {
+            return i;
+        }
+    }
+
+    if (cache->config.replacement == CACHE_PLRU)
+    {
+        return plru_victim(cache, set);
+    }
+
+    for (int i = 1; i < cache->config.ways; ++i)
+    {
+        if (lines[i].last_use < lines[victim].last_use)
+        {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+int
+APEX_cache_access(APEX_Cache *cache, uint32_t address, int is_write)
+{
+    uint64_t line_address = ((uint64_t)address * 4) >> cache->line_shift;
+    int set = line_address & (cache->num_sets - 1);
+    uint32_t tag = line_address / cache->num_sets;
+    APEX_Cache_Line *lines = &cache->lines[set * cache->config.ways];
+    APEX_Cache_Line *line;
+    int way;
+
+    if (is_write)
+    {
+        cache->writes++;
+    }
+    else
+    {
+        cache->reads++;
+    }
+
+    for (way = 0; way < cache->config.ways; ++way)
+    {
+        if (lines[way].valid && lines[way].tag == tag)
+        {
+            cache->hits++;
+            touch_line(cache, set, way);
+            lines[way].dirty |= is_write && cache->config.write_back;
+            return cache->config.hit_latency;
+        }
+    }
+
+    cache->misses++;
+
+    /* Write-through stores that miss go to the write buffer, no line is
+     * allocated */
+    if (is_write && !cache->config.write_back)
+    {
+        return cache->config.hit_latency;
+    }
+
+    way = choose_victim(cache, set);
+    line = &lines[way];
+
+    if (line->valid)
+    {
+        cache->evictions++;
+        if (line->dirty)
+        {
+            cache->writebacks++;
+        }
+    }
+
+    line->valid = TRUE;
+    line->dirty = is_write;
+    line->tag = tag;
+    touch_line(cache, set, way);
+    return cache->config.miss_latency;
+}
+
+void
+APEX_cache_print_stats(const APEX_Cache *cache, const char *name)
+{
+    printf("APEX_CPU: %s %d bytes %d-way %d byte lines, reads = %llu writes = %llu "
+           "hits = %llu misses = %llu evictions = %llu writebacks = %llu\n",
+           name, cache->config.size, cache->config.ways, cache->config.line_size,
+           (unsigned long long)cache->reads, (unsigned long long)cache->writes,
+           (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+           (unsigned long long)cache->evictions, (unsigned long long)cache->writebacks);
+}
@@ -0,0 +1,80 @@
+/*
+ * apex_cache.h
+ * Contains the set-associative cache timing model
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+#include <stdint.h>
+
+/* Replacement policies */
+#define CACHE_LRU 0
+#define CACHE_PLRU 1 /* Tree pseudo-LRU, needs a power of two ways */
+
+/* Geometry and timing of a cache. The cache only models timing, the data
+ * stays in the cpu's data memory. A size of 0 disables the cache, every
+ * access then takes one cycle. */
+typedef struct APEX_Cache_Config
+{
+    int size;         /* Bytes */
+    int line_size;    /* Bytes */
+    int ways;
+    int replacement;  /* CACHE_LRU or CACHE_PLRU */
+    int write_back;   /* Write-back and write-allocate, else write-through
+                       * and no-write-allocate with a write buffer */
+    int hit_latency;  /* Cycles */
+    int miss_latency; /* Cycles */
+} APEX_Cache_Config;
+
+typedef struct APEX_Cache_Line
+{
+    uint32_t tag;
+    uint32_t last_use; /* For LRU replacement */
+    uint8_t valid;
+    uint8_t dirty;
+} APEX_Cache_Line;
+
+typedef struct APEX_Cache
+{
+    APEX_Cache_Config config;
+    int num_sets;
+    int line_shift;
+    APEX_Cache_Line *lines; /* num_sets * ways */
+    uint64_t *plru;         /* Tree bits of each set */
+    uint32_t use_clock;
+
+    /* Statistics */
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;  /* Valid lines replaced */
+    uint64_t writebacks; /* Dirty lines replaced */
+} APEX_Cache;
+
+/* Fills 'config' with a disabled cache and, for when it is enabled, a 4 KiB,
+ * 2-way, 32 byte line, LRU, write-back cache with 1 and 10 cycle latencies */
+void APEX_cache_config_init(APEX_Cache_Config *config);
+
+/* Updates 'config' from a "key=value,..." list with the keys size, line,
+ * ways, repl (lru or plru), write (wb or wt), hit and miss. Returns 0, or -1
+ * on an unknown key. */
+int APEX_cache_config_parse(APEX_Cache_Config *config, const char *spec);
+
+/* Returns 0 on success, -1 if the geometry is invalid or the tags can not be
+ * allocated */
+int APEX_cache_init(APEX_Cache *cache, const APEX_Cache_Config *config);
+void APEX_cache_free(APEX_Cache *cache);
+
+/* Looks up the word at 'address', updates tags and counters and returns the
+ * cycles the access takes */
+int APEX_cache_access(APEX_Cache *cache, uint32_t address, int is_write);
+
+/* Prints the counters, prefixed with 'name' */
+void APEX_cache_print_stats(const APEX_Cache *cache, const char *name);
+
+#endif
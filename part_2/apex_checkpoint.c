@@ -0,0 +1,462 @@
+/*
+ * apex_checkpoint.c
+ * Contains functions to save APEX cpu state to a checkpoint file and to
+ * restore it
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define CHECKPOINT_MAGIC "APEXCKPT"
+#define CHECKPOINT_VERSION 8
+
+/* Geometry of a cache whose tags are in a checkpoint: sets * ways lines, then
+ * one tree word per set. A disabled cache has no sets. */
+typedef struct Checkpoint_Cache
+{
+    int32_t sets;
+    int32_t ways;
+    int32_t line_size;
+    uint32_t use_clock;
+} Checkpoint_Cache;
+
+/* On-disk layout of a checkpoint, the file is this structure as is followed
+ * by the 'btb_entries' BTB entries, the I-cache and D-cache tags and
+ * 'num_pages' Checkpoint_Page records of the sparse data memory. Sizes of the
+ * host structures are recorded so that a checkpoint written by a build
+ * with a different latch layout is rejected instead of misread. */
+typedef struct APEX_Checkpoint
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t stage_size;     /* sizeof(CPU_Stage) */
+    uint32_t reg_file_size;  /* REG_FILE_SIZE */
+    uint32_t data_mem_size;  /* DATA_MEMORY_SIZE */
+    uint64_t code_hash;      /* Hash of the code memory it was taken from */
+    int32_t code_memory_size;
+    uint32_t num_pages;      /* Sparse data memory pages that follow */
+    int32_t btb_entries;     /* BTB geometry, the entries follow */
+    int32_t btb_ways;
+    uint32_t btb_use_clock;
+    Checkpoint_Cache icache; /* Cache geometry, the tags follow the BTB */
+    Checkpoint_Cache dcache;
+
+    int32_t pc;
+    int32_t clock;
+    int32_t insn_completed;
+    int32_t insn_fastforwarded;
+    int32_t fetch_from_next_cycle;
+    int32_t halted;
+    int32_t regs[REG_FILE_SIZE];
+    uint32_t reg_busy;
+    uint8_t reg_pending[REG_FILE_SIZE + 1];
+    APEX_Flags cc_flags;
+    CPU_Stage stage[NUM_STAGES];
+    int32_t num_lanes[NUM_STAGES];
+    CPU_Stage lane[NUM_STAGES][APEX_MAX_WIDTH - 1];
+    int32_t num_in_flight;
+    CPU_Stage in_flight[FU_MAX_IN_FLIGHT];
+    int32_t data_memory[DATA_MEMORY_SIZE];
+} APEX_Checkpoint;
+
+/* One page of the sparse data memory */
+typedef struct Checkpoint_Page
+{
+    uint32_t page;
+    int32_t words[MEM_PAGE_WORDS];
+} Checkpoint_Page;
+
+/* State of APEX_cpu_checkpoint_save() while the pages are written */
+typedef struct Page_Writer
+{
+    FILE *fp;
+    uint32_t count;
+    int failed;
+} Page_Writer;
+
+static void
+count_page(uint32_t page, const int32_t *words, void *arg)
+{
+    ((Page_Writer *)arg)->count++;
+}
+
+static void
+write_page(uint32_t page, const int32_t *words, void *arg)
+{
+    Page_Writer *writer = arg;
+
+    if (fwrite(&page, sizeof(page), 1, writer->fp) != 1
+        || fwrite(words, sizeof(int32_t), MEM_PAGE_WORDS, writer->fp) != MEM_PAGE_WORDS)
+    {
+        writer->failed = TRUE;
+    }
+}
+
+/* Bytes of the tags of a cache in a checkpoint */
+static uint64_t
+cache_tag_bytes(const Checkpoint_Cache *geometry)
+{
+    return (uint64_t)geometry->sets * geometry->ways * sizeof(APEX_Cache_Line)
+           + (uint64_t)geometry->sets * sizeof(uint64_t);
+}
+
+static int
+valid_cache_geometry(const Checkpoint_Cache *geometry)
+{
+    return geometry->sets >= 0 && geometry->sets <= (1 << 24)
+           && geometry->ways >= 0 && geometry->ways <= (1 << 24);
+}
+
+static void
+save_cache_geometry(Checkpoint_Cache *geometry, const APEX_Cache *cache)
+{
+    geometry->sets = cache->lines ? cache->num_sets : 0;
+    geometry->ways = cache->config.ways;
+    geometry->line_size = cache->config.line_size;
+    geometry->use_clock = cache->use_clock;
+}
+
+/* Returns 0 on success, -1 on a write error */
+static int
+write_cache_tags(FILE *fp, const Checkpoint_Cache *geometry, const APEX_Cache *cache)
+{
+    size_t num_lines = (size_t)geometry->sets * geometry->ways;
+
+    if (fwrite(cache->lines, sizeof(APEX_Cache_Line), num_lines, fp) != num_lines
+        || fwrite(cache->plru, sizeof(uint64_t), geometry->sets, fp) != (size_t)geometry->sets)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* Restores the tags at 'tags' if the cache has the saved geometry, a cache of
+ * another geometry starts cold */
+static void
+restore_cache_tags(APEX_Cache *cache, const Checkpoint_Cache *geometry,
+                   const unsigned char *tags)
+{
+    size_t num_lines = (size_t)geometry->sets * geometry->ways;
+
+    if (cache->lines && geometry->sets == cache->num_sets && geometry->ways == cache->config.ways
+        && geometry->line_size == cache->config.line_size)
+    {
+        memcpy(cache->lines, tags, num_lines * sizeof(APEX_Cache_Line));
+        memcpy(cache->plru, tags + num_lines * sizeof(APEX_Cache_Line),
+               geometry->sets * sizeof(uint64_t));
+        cache->use_clock = geometry->use_clock;
+    }
+}
+
+/* Groups in the latches must fit the width of the restoring cpu */
+static int
+valid_lanes(const APEX_CPU *cpu, const APEX_Checkpoint *ckpt)
+{
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        if (ckpt->num_lanes[i] < 0 || ckpt->num_lanes[i] >= APEX_MAX_WIDTH
+            || (!ckpt->stage[i].has_no_insn && ckpt->num_lanes[i] >= cpu->config.width))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* An instruction in a latch must index the register file, the execute
+ * handlers and the profile of the restoring cpu */
+static int
+valid_latch(const APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    if (stage->cause >= NUM_CYCLE_CAUSES)
+    {
+        return FALSE;
+    }
+    if (stage->has_no_insn)
+    {
+        return TRUE;
+    }
+    return stage->opcode < NUM_OPCODES && stage->rd < REG_FILE_SIZE
+           && stage->rs1 < REG_FILE_SIZE && stage->rs2 < REG_FILE_SIZE
+           && (stage->stall_reg < REG_FILE_SIZE
+               || (stage->stall_reg == STALL_REG_NONE && stage->cause != CYCLE_DATA_STALL))
+           && stage->pc >= 4000 && (stage->pc - 4000) % 4 == 0
+           && (stage->pc - 4000) / 4 < cpu->code_memory_size;
+}
+
+static int
+valid_latches(const APEX_CPU *cpu, const APEX_Checkpoint *ckpt)
+{
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        /* Before the first cycle the Fetch latch is armed but holds nothing */
+        if (!valid_latch(cpu, &ckpt->stage[i]) && (i != Fetch || ckpt->clock > 1))
+        {
+            return FALSE;
+        }
+        for (int j = 0; j < ckpt->num_lanes[i]; ++j)
+        {
+            if (!valid_latch(cpu, &ckpt->lane[i][j]))
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    for (int i = 0; i < ckpt->num_in_flight; ++i)
+    {
+        if (!valid_latch(cpu, &ckpt->in_flight[i]))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * FNV-1a hash of the decoded code memory, field by field so that structure
+ * padding does not take part
+ */
+static uint64_t
+hash_code_memory(const APEX_CPU *cpu)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int fields[6];
+
+    for (int i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const APEX_Instruction *ins = &cpu->code_memory[i];
+
+        fields[0] = ins->opcode;
+        fields[1] = ins->rd;
+        fields[2] = ins->rs1;
+        fields[3] = ins->rs2;
+        fields[4] = ins->imm;
+        fields[5] = ins->flags;
+
+        for (size_t j = 0; j < sizeof(fields); ++j)
+        {
+            hash ^= ((const unsigned char *)fields)[j];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+/*
+ * Writes the complete state of the cpu to 'filename'.
+ * Returns 0 on success, -1 on failure. Only the state of the in-order
+ * pipeline of a cpu with its own data memory can be saved.
+ */
+int
+APEX_cpu_checkpoint_save(const APEX_CPU *cpu, const char *filename)
+{
+    APEX_Checkpoint *ckpt;
+    Page_Writer writer = {0};
+    FILE *fp;
+    int ret = -1;
+
+    if (cpu->ooo || cpu->shared)
+    {
+        return -1;
+    }
+
+    /* Too large for the stack, data memory alone is 16 KiB */
+    ckpt = calloc(1, sizeof(*ckpt));
+    if (!ckpt)
+    {
+        return -1;
+    }
+
+    memcpy(ckpt->magic, CHECKPOINT_MAGIC, sizeof(ckpt->magic));
+    ckpt->version = CHECKPOINT_VERSION;
+    ckpt->stage_size = sizeof(CPU_Stage);
+    ckpt->reg_file_size = REG_FILE_SIZE;
+    ckpt->data_mem_size = DATA_MEMORY_SIZE;
+    ckpt->code_hash = hash_code_memory(cpu);
+    ckpt->code_memory_size = cpu->code_memory_size;
+    APEX_mem_for_each_page(&cpu->memory, count_page, &writer);
+    ckpt->num_pages = writer.count;
+    ckpt->btb_entries = cpu->btb.num_sets * cpu->btb.ways;
+    ckpt->btb_ways = cpu->btb.ways;
+    ckpt->btb_use_clock = cpu->btb.use_clock;
+    save_cache_geometry(&ckpt->icache, &cpu->icache);
+    save_cache_geometry(&ckpt->dcache, &cpu->dcache);
+
+    ckpt->pc = cpu->pc;
+    ckpt->clock = cpu->clock;
+    ckpt->insn_completed = cpu->insn_completed;
+    ckpt->insn_fastforwarded = cpu->insn_fastforwarded;
+    ckpt->fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    ckpt->halted = cpu->halted;
+    memcpy(ckpt->regs, cpu->regs, sizeof(ckpt->regs));
+    ckpt->reg_busy = cpu->reg_busy;
+    memcpy(ckpt->reg_pending, cpu->reg_pending, sizeof(ckpt->reg_pending));
+    ckpt->cc_flags = cpu->cc_flags;
+    memcpy(ckpt->stage, cpu->stage, sizeof(ckpt->stage));
+    memcpy(ckpt->num_lanes, cpu->num_lanes, sizeof(ckpt->num_lanes));
+    memcpy(ckpt->lane, cpu->lane, sizeof(ckpt->lane));
+    ckpt->num_in_flight = cpu->num_in_flight;
+    memcpy(ckpt->in_flight, cpu->in_flight, sizeof(ckpt->in_flight));
+    memcpy(ckpt->data_memory, cpu->data_memory, sizeof(ckpt->data_memory));
+
+    fp = fopen(filename, "wb");
+    if (fp)
+    {
+        writer.fp = fp;
+        if (fwrite(ckpt, sizeof(*ckpt), 1, fp) == 1
+            && fwrite(cpu->btb.entries, sizeof(APEX_BTB_Entry), ckpt->btb_entries, fp)
+                   == (size_t)ckpt->btb_entries
+            && !write_cache_tags(fp, &ckpt->icache, &cpu->icache)
+            && !write_cache_tags(fp, &ckpt->dcache, &cpu->dcache))
+        {
+            APEX_mem_for_each_page(&cpu->memory, write_page, &writer);
+            ret = writer.failed ? -1 : 0;
+        }
+
+        if (fclose(fp))
+        {
+            ret = -1;
+        }
+    }
+
+    free(ckpt);
+    return ret;
+}
+
+/*
+ * Restores the state saved in 'filename' into a cpu created from the same
+ * input file. The checkpoint is mapped read-only rather than read into a
+ * buffer. Returns 0 on success, -1 if the file can not be read, was not
+ * taken from this program or the cpu runs the OoO engine or shares its data
+ * memory.
+ */
+int
+APEX_cpu_checkpoint_restore(APEX_CPU *cpu, const char *filename)
+{
+    const APEX_Checkpoint *ckpt;
+    const APEX_BTB_Entry *btb_entries;
+    const unsigned char *icache_tags;
+    const unsigned char *dcache_tags;
+    const Checkpoint_Page *pages;
+    struct stat st;
+    void *map;
+    int fd;
+    int ret = -1;
+
+    if (cpu->ooo || cpu->shared)
+    {
+        return -1;
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(APEX_Checkpoint))
+    {
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    ckpt = map;
+
+    /* The sizes of the sections are validated before they are located */
+    if (memcmp(ckpt->magic, CHECKPOINT_MAGIC, sizeof(ckpt->magic)) == 0
+        && ckpt->version == CHECKPOINT_VERSION
+        && ckpt->stage_size == sizeof(CPU_Stage)
+        && ckpt->reg_file_size == REG_FILE_SIZE
+        && ckpt->data_mem_size == DATA_MEMORY_SIZE
+        && ckpt->code_memory_size == cpu->code_memory_size
+        && ckpt->code_hash == hash_code_memory(cpu)
+        && ckpt->btb_entries >= 0 && ckpt->btb_entries <= (1 << 24)
+        && valid_cache_geometry(&ckpt->icache) && valid_cache_geometry(&ckpt->dcache)
+        && ckpt->num_in_flight >= 0 && ckpt->num_in_flight <= FU_MAX_IN_FLIGHT
+        && valid_lanes(cpu, ckpt)
+        && valid_latches(cpu, ckpt)
+        && ckpt->num_pages <= MEM_DIR_SIZE * MEM_TABLE_SIZE
+        && (uint64_t)st.st_size == sizeof(APEX_Checkpoint)
+                                   + (uint64_t)ckpt->btb_entries * sizeof(APEX_BTB_Entry)
+                                   + cache_tag_bytes(&ckpt->icache)
+                                   + cache_tag_bytes(&ckpt->dcache)
+                                   + (uint64_t)ckpt->num_pages * sizeof(Checkpoint_Page))
+    {
+        btb_entries = (const APEX_BTB_Entry *)(ckpt + 1);
+        icache_tags = (const unsigned char *)(btb_entries + ckpt->btb_entries);
+        dcache_tags = icache_tags + cache_tag_bytes(&ckpt->icache);
+        pages = (const Checkpoint_Page *)(dcache_tags + cache_tag_bytes(&ckpt->dcache));
+
+        cpu->pc = ckpt->pc;
+        cpu->clock = ckpt->clock;
+        cpu->insn_completed = ckpt->insn_completed;
+        cpu->insn_fastforwarded = ckpt->insn_fastforwarded;
+        cpu->fetch_from_next_cycle = ckpt->fetch_from_next_cycle;
+        cpu->halted = ckpt->halted;
+        memcpy(cpu->regs, ckpt->regs, sizeof(ckpt->regs));
+        cpu->reg_busy = ckpt->reg_busy;
+        memcpy(cpu->reg_pending, ckpt->reg_pending, sizeof(ckpt->reg_pending));
+        cpu->cc_flags = ckpt->cc_flags;
+        memcpy(cpu->stage, ckpt->stage, sizeof(ckpt->stage));
+        memcpy(cpu->num_lanes, ckpt->num_lanes, sizeof(ckpt->num_lanes));
+        memcpy(cpu->lane, ckpt->lane, sizeof(ckpt->lane));
+        memcpy(cpu->in_flight, ckpt->in_flight, sizeof(ckpt->in_flight));
+        cpu->num_in_flight = ckpt->num_in_flight;
+
+        /* Unit occupancy follows from the instructions in flight */
+        for (int i = 0; i < NUM_FU_CLASSES; ++i)
+        {
+            cpu->fu[i].in_flight = 0;
+        }
+        for (int i = 0; i < cpu->num_in_flight; ++i)
+        {
+            cpu->fu[APEX_fu_class(cpu->in_flight[i].opcode)].in_flight++;
+        }
+        memcpy(cpu->data_memory, ckpt->data_memory, sizeof(ckpt->data_memory));
+        ret = 0;
+
+        /* A BTB of another geometry starts cold */
+        if (ckpt->btb_entries == cpu->btb.num_sets * cpu->btb.ways
+            && ckpt->btb_ways == cpu->btb.ways && ckpt->btb_entries)
+        {
+            memcpy(cpu->btb.entries, btb_entries, ckpt->btb_entries * sizeof(APEX_BTB_Entry));
+            cpu->btb.use_clock = ckpt->btb_use_clock;
+        }
+
+        restore_cache_tags(&cpu->icache, &ckpt->icache, icache_tags);
+        restore_cache_tags(&cpu->dcache, &ckpt->dcache, dcache_tags);
+
+        for (uint32_t i = 0; i < ckpt->num_pages; ++i)
+        {
+            int32_t *words = APEX_mem_page(&cpu->memory, pages[i].page, TRUE);
+
+            if (!words)
+            {
+                ret = -1;
+                break;
+            }
+            memcpy(words, pages[i].words, sizeof(pages[i].words));
+        }
+    }
+
+    munmap(map, st.st_size);
+    return ret;
+}
@@ -6,42 +6,18 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "apex_cpu.h"
+#include "apex_isa.h"
 #include "apex_macros.h"
+#include "apex_ooo.h"
 
-/* Converts the PC(4000 series) into array index for code memory
- *
- * Note: You are not supposed to edit this function
- */
-
-/* Flag to enable to display register and memory values */
-int ENABLE_DISPLAY;
-
-/* Flag to enable counting code_memory_size */
-int ENABLE_COUNTING;
-
-struct flagCheck
-{
-    int flagIsUsed;
-    int flagIsNotUsed;
-    int isRegValEmpty;
-}flagCheck;
-
-// int emptyMemory = 0;
-// int emptyExecute = 0;
-// int flagIsUsed = 1;
-// int flagIsNotUsed = 0;
-// int isRegValEmpty = 0;
-
-static int
-get_code_memory_index_from_pc(const int pc)
-{
-    return (pc - 4000) / 4;
-}
+/* Latches are copied on every transfer, keep each within one cache line */
+_Static_assert(sizeof(CPU_Stage) <= 64, "CPU_Stage must fit in a cache line");
 
 static void
 print_instruction(const CPU_Stage *stage)
@@ -56,13 +32,13 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_OR:
         case OPCODE_XOR:
         {
-            printf("%s,R%d,R%d,R%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2);
+            printf("%s,R%d,R%d,R%d", get_opcode_str(stage->opcode), stage->rd, stage->rs1, stage->rs2);
             break;
         }
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d", stage->opcode_str, stage->rd, stage->imm);
+            printf("%s,R%d,#%d", get_opcode_str(stage->opcode), stage->rd, stage->imm);
             break;
         }
 
@@ -72,14 +48,14 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_SUBL:
         case OPCODE_JALR:
         {
-            printf("%s,R%d,R%d,#%d", stage->opcode_str, stage->rd, stage->rs1, stage->imm);
+            printf("%s,R%d,R%d,#%d", get_opcode_str(stage->opcode), stage->rd, stage->rs1, stage->imm);
             break;
         }
 
         case OPCODE_STORE:
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,#%d", stage->opcode_str, stage->rs1, stage->rs2, stage->imm);
+            printf("%s,R%d,R%d,#%d", get_opcode_str(stage->opcode), stage->rs1, stage->rs2, stage->imm);
             break;
         }
 
@@ -90,27 +66,27 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_BN:
         case OPCODE_BNN:
         {
-            printf("%s,#%d", stage->opcode_str, stage->imm);
+            printf("%s,#%d", get_opcode_str(stage->opcode), stage->imm);
             break;
         }
 
         case OPCODE_HALT:
         case OPCODE_NOP:
         {
-            printf("%s", stage->opcode_str);
+            printf("%s", get_opcode_str(stage->opcode));
             break;
         }
 
         case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d", stage->opcode_str, stage->rs1, stage->rs2);
+            printf("%s,R%d,R%d", get_opcode_str(stage->opcode), stage->rs1, stage->rs2);
             break;
         }
 
         case OPCODE_JUMP:
         case OPCODE_CML:
         {
-            printf("%s,R%d,#%d", stage->opcode_str, stage->rs1, stage->imm);
+            printf("%s,R%d,#%d", get_opcode_str(stage->opcode), stage->rs1, stage->imm);
             break;
         }
     }
@@ -128,6 +104,38 @@ print_stage_content(const char *name, const CPU_Stage *stage)
     printf("\n");
 }
 
+void
+APEX_cpu_print_stage(const char *name, const CPU_Stage *stage)
+{
+    print_stage_content(name, stage);
+}
+
+/*
+ * Prints the instruction in a stage latch followed by the younger lanes of
+ * its group
+ */
+static void
+print_group(const APEX_CPU *cpu, const char *name, int stage)
+{
+    print_stage_content(name, &cpu->stage[stage]);
+
+    for (int i = 0; i < cpu->num_lanes[stage]; ++i)
+    {
+        print_stage_content(name, &cpu->lane[stage][i]);
+    }
+}
+
+/*
+ * Passes the group in latch 'stage' on to the next latch
+ */
+static void
+copy_group(APEX_CPU *cpu, int stage)
+{
+    cpu->stage[stage + 1] = cpu->stage[stage];
+    memcpy(cpu->lane[stage + 1], cpu->lane[stage], cpu->num_lanes[stage] * sizeof(CPU_Stage));
+    cpu->num_lanes[stage + 1] = cpu->num_lanes[stage];
+}
+
 /* Debug function which prints the register file
  *
  * Note: You are not supposed to edit this function
@@ -155,886 +163,995 @@ print_reg_file(const APEX_CPU *cpu)
 }
 
 /*
- * Fetch Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Marks the destinations of an issuing instruction busy in the scoreboard
  */
 static void
-APEX_fetch(APEX_CPU *cpu)
+scoreboard_acquire(APEX_CPU *cpu, uint32_t dst_mask)
 {
-    CPU_Stage* stage = &cpu->stage[Fetch];
-    if (!stage->has_no_insn && !stage->is_interrupted) {
-        APEX_Instruction *current_ins;
-    /*if (cpu->fetch.has_insn == TRUE)
-    {
-        /* This fetches new branch target instruction from next cycle
-        if (cpu->fetch_from_next_cycle == TRUE)
-        {
-            cpu->fetch_from_next_cycle = FALSE;
-
-            /* Skip this cycle
-            return;
-        }*/
-
-        /* Store current PC in fetch latch */
-        stage->pc = cpu->pc;
-
-        /* Index into code memory using this pc and copy all instruction fields
-        * into fetch latch  */
-        
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(stage->opcode, current_ins->opcode_str);
-        stage->rd = current_ins->rd;
-        stage->rs1 = current_ins->rs1;
-        stage->rs2 = current_ins->rs2;
-        stage->imm = current_ins->imm;
-
-        /*if (cpu->decode.is_interrupted == flagIsNotUsed)
-        {
-            /* Update PC for next instruction */
-        cpu->pc += 4;
-        /* Copy data from fetch latch to decode latch*/
-        if (!cpu->stage[DRF].is_interrupted) {
-            cpu->stage[DRF] = cpu->stage[Fetch];
-        }
-        else {
-            stage->is_interrupted = 1;
-        }
+    cpu->reg_busy |= dst_mask;
 
-        if (ENABLE_DEBUG_MESSAGES) {
-            print_stage_content("Fetch", stage);
-        }
+    while (dst_mask)
+    {
+        cpu->reg_pending[__builtin_ctz(dst_mask)]++;
+        dst_mask &= dst_mask - 1;
     }
-    else {
-        /* If HALT reached into WB stage, then finish program in this stage*/
-        if (strcmp(cpu->stage[WB].opcode, "HALT") == 0) {
-            cpu->code_memory_size = cpu->clock + 1;
-        }
-
-        /* If current stage contains branch instructions, then stop stalling the stage and show the content of fetch stage
-        */
-        if (strcmp(stage->opcode, "BZ") == 0 || strcmp(stage->opcode, "BNZ") == 0 || strcmp(stage->opcode, "BP") == 0 || 
-            strcmp(stage->opcode, "BNP") == 0 || strcmp(stage->opcode, "BN") == 0 || strcmp(stage->opcode, "BNN") == 0) {
-                stage->is_interrupted = 0;
-            if (ENABLE_DEBUG_MESSAGES) {
-                print_stage_content("Fetch", stage);
-            }
-        }
-
-        /* If DRF stage is not interrupted, and does not contain branch intructions, then
-        * stop stalling fetch stage, and copy data into the next stage.
-        */
-        if (!cpu->stage[DRF].is_interrupted && (strcmp(cpu->stage[DRF].opcode, "BZ") != 0 || strcmp(cpu->stage[DRF].opcode, "BNZ") != 0 || 
-                                                strcmp(cpu->stage[DRF].opcode, "BP") != 0 || strcmp(cpu->stage[DRF].opcode, "BNP") != 0 || 
-                                                strcmp(cpu->stage[DRF].opcode, "BN") != 0 || strcmp(cpu->stage[DRF].opcode, "BNN") != 0)) {
-            stage->is_interrupted = 0;
-            cpu->stage[DRF] = cpu->stage[Fetch];
-            if (ENABLE_DEBUG_MESSAGES) {
-                print_stage_content("Fetch", stage);
-            }
-        }
+}
 
-        /* Show if next stage is not HALT */
-        if (cpu->stage[DRF].is_interrupted && strcmp(cpu->stage[DRF].opcode, "HALT") != 0) {
-            if (ENABLE_DEBUG_MESSAGES) {
-                print_stage_content("Fetch", stage);
-            }
-        }
+/*
+ * Drops one pending writer of each destination, a register becomes valid
+ * again when its last in-flight writer is written back
+ */
+static void
+scoreboard_release(APEX_CPU *cpu, uint32_t dst_mask)
+{
+    while (dst_mask)
+    {
+        int reg = __builtin_ctz(dst_mask);
 
-        if (ENABLE_DEBUG_MESSAGES) {
-            print_stage_content("Fetch: EMPTY\n", stage);
+        if (--cpu->reg_pending[reg] == 0)
+        {
+            cpu->reg_busy &= ~(1u << reg);
         }
+        dst_mask &= dst_mask - 1;
     }
-    return 0;
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Accounts the current cycle of 'stage' to 'cause'. A stage that passes no
+ * instruction on leaves a bubble of the same cause in the next latch.
  */
 static void
-APEX_decode(APEX_CPU *cpu)
+account_cycle(APEX_CPU *cpu, int stage, int cause)
 {
-    CPU_Stage* stage = &cpu->stage[DRF];
-    if (!stage->has_no_insn && !stage->is_interrupted)
-    {
-        /* Read operands from register file based on the instruction type */
-        switch (stage->opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_DIV:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-                if (cpu->regChecking[stage->rs1] && cpu->regChecking[stage->rs2])
-                {
-                    cpu->regChecking[stage->rd] = 0;
-                    stage->rs1_value = cpu->regs[stage->rs1];
-                    stage->rs2_value = cpu->regs[stage->rs2];
-                }
-                else
-                {
-                    stage->is_interrupted = 1;   
-                }
-                break;
-            }
-            
-            case OPCODE_MOVC:
-            {
-                cpu->regChecking[stage->rd] = 0;
-                /* MOVC doesn't have register operands */
-                break;
-            }
-
-            case OPCODE_LOAD:
-            case OPCODE_LOADP:
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_JALR:
-            {
-                if (cpu->regChecking[stage->rs1])
-                {
-                    cpu->regChecking[stage->rd] = 1;
-                    stage->memory_address = stage->rs1_value + stage->imm;
-                    cpu->regs[stage->rd] = stage->pc + 4;
-                }
-                else
-                {
-                    stage->is_interrupted = 1;
-                }
-                break;
-            }
-
-
-            case OPCODE_STORE:
-            case OPCODE_STOREP:
-            {
-                if (cpu->regChecking[stage->rs1] && cpu->regChecking[stage->rs2]) {
-                    cpu->regChecking[stage->rd] = 0;
-                    stage->rs1_value = cpu->regs[stage->rs1];
-                    stage->rs2_value = cpu->regs[stage->rs2];
-                }
-                else {
-                    stage->is_interrupted = 1;
-                }
-                break;
-            }
+    cpu->stats.stage_cycles[stage][cause]++;
 
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_BN:
-            case OPCODE_BNN:
-            {
-                if (!cpu->zero_flag_valid) {
-                    stage->is_interrupted = 1;
-                }
-                break;
-            }
+    if (cause != CYCLE_USEFUL && stage + 1 < NUM_STAGES && cpu->stage[stage + 1].has_no_insn)
+    {
+        cpu->stage[stage + 1].cause = cause;
+    }
+}
 
-            case OPCODE_HALT:
-            {
-                cpu->stage[Fetch].is_interrupted = 1;
-                stage->is_interrupted = 1;
-                break;
-            }
+/*
+ * Youngest instruction of the group in latch 'stage' that writes scoreboard
+ * 'bit', or NULL. Adds the number of writers in the group to 'writers'.
+ */
+static const CPU_Stage *
+group_writer(const APEX_CPU *cpu, int stage, uint32_t bit, int *writers)
+{
+    const CPU_Stage *writer = NULL;
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
+    if (cpu->stage[stage].has_no_insn)
+    {
+        return NULL;
+    }
 
-            case OPCODE_CMP:
-            {
-                if (cpu->regChecking[stage->rs1] && cpu->regChecking[stage->rs2])
-                {
-                    cpu->regChecking[stage->rd] = 0;
-                    stage->rs1_value = cpu->regs[stage->rs1];
-                    stage->rs2_value = cpu->regs[stage->rs2];
-                }
-                else
-                {
-                    stage->is_interrupted = 1;
-                }
-                break;
-            }
+    if (cpu->stage[stage].dst_mask & bit)
+    {
+        writer = &cpu->stage[stage];
+        (*writers)++;
+    }
 
-            case OPCODE_CML:
-            {
-                if (cpu->regChecking[stage->rs1])
-                {
-                    cpu->regChecking[stage->rd] = 0;
-                    stage->rs1_value = cpu->regs[stage->rs1];
+    for (int i = 0; i < cpu->num_lanes[stage]; ++i)
+    {
+        if (cpu->lane[stage][i].dst_mask & bit)
+        {
+            writer = &cpu->lane[stage][i];
+            (*writers)++;
+        }
+    }
+    return writer;
+}
 
-                    /*int result = stage->rs1_value - stage->imm;
+/*
+ * Reads source register 'reg' for Decode/RF, from the register file or
+ * through the bypass network. Decode runs after Execute and Memory in a
+ * cycle, so the MEM latch holds the results computed in EX this cycle and
+ * the WB latch the results that left MEM. Returns FALSE when the value is not
+ * available yet: a writer is still in Execute or a functional unit, or is a
+ * load still in the MEM latch.
+ */
+static int
+read_source(const APEX_CPU *cpu, int reg, int *value)
+{
+    const CPU_Stage *mem;
+    const CPU_Stage *wb;
+    uint32_t bit = 1u << reg;
+    int writers = 0;
 
-                    cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                    cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                    cpu->cc_flags.P = (result > 0) ? 1 : 0;*/
-                }
-                else
-                {
-                    stage->is_interrupted = 1;
-                }
-                break;
-            }
+    if (!(cpu->reg_busy & bit))
+    {
+        if (reg < REG_FILE_SIZE)
+        {
+            *value = cpu->regs[reg];
+        }
+        return TRUE;
+    }
 
-            case OPCODE_JUMP:
-            {
-                if (cpu->regChecking[stage->rs1])
-                {
-                    cpu->regChecking[stage->rd] = 0;
-                    stage->rs1_value = cpu->regs[stage->rs1];
-                    stage->memory_address = stage->rs1_value + stage->imm;
-                }
-                else
-                {
-                    stage->is_interrupted = 1;
-                }
-                break;
-            }
+    if (!cpu->config.forwarding)
+    {
+        return FALSE;
+    }
 
-            default:
-            {
-                break;
-            }
-        }
-        
-        /* Copy data from decode stage to execute stage
-        if decode stage is not stalled
-        else transfer bubble*/
-        if (!stage->is_interrupted) {
-            cpu->stage[EX] = cpu->stage[DRF];
-        }
-        else {
-            cpu->stage[EX].pc = 0000;
-        }
+    /* All in-flight writers must have reached the bypass latches, a writer in
+     * a unit can be younger than the one in the MEM latch */
+    mem = group_writer(cpu, MEM, bit, &writers);
+    wb = group_writer(cpu, WB, bit, &writers);
+    if (writers < cpu->reg_pending[reg])
+    {
+        return FALSE;
+    }
 
-        if (ENABLE_DEBUG_MESSAGES) {
-            print_stage_content("Decode/RF", stage);
+    /* The MEM latch holds the youngest writer */
+    if (mem)
+    {
+        /* Load-use interlock, the loaded data is read from memory next cycle,
+         * only the LOADP address increment is ready */
+        if ((mem->flags & INSN_IS_LOAD)
+            && !((mem->flags & INSN_WRITES_RS1) && mem->rs1 == reg))
+        {
+            return FALSE;
         }
 
-        if (strcmp(stage->opcode, "HALT") == 0) {
-            cpu->stage[Fetch].is_interrupted = 1;
-            stage->is_interrupted = 1;
+        if (reg < REG_FILE_SIZE)
+        {
+            *value = APEX_stage_result(mem, reg);
         }
-
+        return TRUE;
     }
-    else
+
+    if (wb)
     {
-        /* If current stage does not contain HALT, and next stage is not interrupted, then
-        * current stage is interrupted becuase of dependency between source and destination registers
-        */
-        if (stage->is_interrupted && strcmp(stage->opcode, "HALT") != 0 && !cpu->stage[EX].is_interrupted)
+        if (reg < REG_FILE_SIZE)
         {
-            if (ENABLE_COUNTING)
-            {
-                cpu->code_memory_size++;
-            }
-
-            if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "AND") == 0 ||
-                strcmp(stage->opcode, "OR") == 0 || strcmp(stage->opcode, "EX-OR") == 0 || strcmp(stage->opcode, "MUL") == 0 ||
-                strcmp(stage->opcode, "DIV") == 0 || strcmp(stage->opcode, "STORE") == 0 ||  strcmp(stage->opcode, "STOREP") == 0)
-            {
+            *value = APEX_stage_result(wb, reg);
+        }
+        return TRUE;
+    }
 
-                if (cpu->regChecking[stage->rs1] && cpu->regChecking[stage->rs2])
-                {
+    return FALSE;
+}
 
-                    /* If it is STORE or STOREP, do not make rd invalid */
-                    if (strcmp(stage->opcode, "STORE") != 0 || strcmp(stage->opcode, "STOREP") != 0) {
-                        cpu->regChecking[stage->rd] = 0;
-                    }
-                    stage->rs1_value = cpu->regs[stage->rs1];
-                    stage->rs2_value = cpu->regs[stage->rs2];
-                    stage->is_interrupted = 0;
-                    cpu->stage[EX] = cpu->stage[DRF];
-                }
-            }
+/* Fetch cycles lost on a mispredict: the squashed DRF instruction and the
+ * cycle fetch waits before the correct pc */
+#define MISPREDICT_PENALTY 2
 
-            if (strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "LOADP") == 0 || strcmp(stage->opcode, "ADDL") == 0 ||
-                strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "JALR") == 0)
-            {
-                if (cpu->regChecking[stage->rs1])
-                {
-                    cpu->regChecking[stage->rd] = 0;
-                    stage->rs1_value = cpu->regs[stage->rs1];
-                    stage->is_interrupted = 0;
-                    cpu->stage[EX] = cpu->stage[DRF];
-                }
-            }
+/*
+ * Redirects fetch to 'target' after the mispredicted 'branch' in Execute and
+ * squashes the younger instructions in Fetch and DRF. A branch is always the
+ * last instruction of its group.
+ */
+static void
+control_flow(APEX_CPU *cpu, const CPU_Stage *branch, int target)
+{
+    cpu->stage[DRF].has_no_insn = 1;
+    cpu->stage[DRF].is_interrupted = 0;
+    cpu->stage[DRF].cause = CYCLE_FLUSH;
+    cpu->num_lanes[DRF] = 0;
 
-            if (strcmp(stage->opcode, "JUMP") == 0)
-            {
-                if (cpu->regChecking[stage->rs1])
-                {
-                    stage->rs1_value = cpu->regs[stage->rs1];
-                    stage->is_interrupted = 0;
-                    cpu->stage[EX] = cpu->stage[DRF];
-                }
-            }
+    /* Fetch may have stopped at the end of code memory, restart it. A pending
+     * I-cache miss on the wrong path is dropped. */
+    cpu->stage[Fetch].has_no_insn = 0;
+    cpu->stage[Fetch].is_interrupted = 0;
+    cpu->stage[Fetch].busy = 0;
+    cpu->num_lanes[Fetch] = 0;
 
-            if (strcmp(stage->opcode, "BZ") == 0 || strcmp(stage->opcode, "BNZ") == 0 ||  strcmp(stage->opcode, "BP") == 0 ||
-                strcmp(stage->opcode, "BNP") == 0 || strcmp(stage->opcode, "BN") == 0 || strcmp(stage->opcode, "BNN") == 0)
-            {
-                if (cpu->zero_flag_valid)
-                {
-                    stage->is_interrupted = 0;
-                    cpu->stage[EX] = cpu->stage[DRF];
-                }
-            }
+    cpu->pc = target;
 
-            if (strcmp(stage->opcode, "NOP") == 0)
-            {
-                cpu->regChecking[stage->rd] = 0;
-                cpu->stage[EX] = cpu->stage[DRF];
-            }
+    cpu->btb.mispredicts++;
+    cpu->btb.flush_cycles += MISPREDICT_PENALTY;
 
-            if (ENABLE_DEBUG_MESSAGES) {
-                print_stage_content("Decode/RF", stage);
-            }
+    if (cpu->profile)
+    {
+        cpu->profile[get_code_memory_index_from_pc(branch->pc)].flush_cycles += MISPREDICT_PENALTY;
+    }
 
-            if (strcmp(stage->opcode, "MOVC") == 0)
-            {
-                if (cpu->regChecking[stage->rd])
-                {
-                    cpu->regChecking[stage->rd] = 0;
-                    cpu->regs[stage->rd] = stage->imm;
-                    stage->is_interrupted = 0;
-                    cpu->stage[EX] = cpu->stage[DRF];
-                }
-            }
-        }
+    /* Target is fetched from next cycle */
+    cpu->fetch_from_next_cycle = TRUE;
+}
 
-        if (cpu->stage[EX].is_interrupted && strcmp(cpu->stage[EX].opcode, "HALT") != 0)
-        {
-            if (ENABLE_DEBUG_MESSAGES) {
-                print_stage_content("Decode/RF: EMPTY\n", stage);
-            }
-        }
+/*
+ * Copies code memory entry 'index' at cpu->pc into 'slot' and moves the pc on
+ * to the predicted next instruction. Returns the cycles the fetch takes.
+ */
+static int
+fetch_instruction(APEX_CPU *cpu, CPU_Stage *slot, int index)
+{
+    const APEX_Instruction *current_ins = &cpu->code_memory[index];
+
+    /* Store current PC in fetch latch */
+    slot->pc = cpu->pc;
+
+    /* Copy all instruction fields into the fetch latch */
+    slot->opcode = current_ins->opcode;
+    slot->flags = current_ins->flags;
+    slot->rd = current_ins->rd;
+    slot->rs1 = current_ins->rs1;
+    slot->rs2 = current_ins->rs2;
+    slot->imm = current_ins->imm;
+    slot->src_mask = current_ins->src_mask;
+    slot->dst_mask = current_ins->dst_mask;
+
+    /* Update PC for next instruction, following the BTB prediction. The
+     * latch remembers it so that Execute can detect a mispredict. */
+    cpu->pc = APEX_btb_predict(&cpu->btb, cpu->pc);
+    slot->predicted_pc = cpu->pc;
+
+    if (cpu->icache.lines)
+    {
+        return APEX_cache_access(&cpu->icache, slot->pc / 4, FALSE);
     }
+    return 1;
 }
 
 /*
- * Execute Stage of APEX Pipeline
+ * Fetch Stage of APEX Pipeline
  *
  * Note: You are free to edit this function according to your implementation
  */
 static void
-APEX_execute(APEX_CPU *cpu)
+APEX_fetch(APEX_CPU *cpu)
 {
-    CPU_Stage* stage = &cpu->stage[EX];
-    if (!stage->has_no_insn && !stage->is_interrupted)
+    CPU_Stage *stage = &cpu->stage[Fetch];
+    const CPU_Stage *prev;
+    int latency;
+    int index;
+
+    /* Fetch stops once HALT is decoded or the end of code memory is reached */
+    if (stage->has_no_insn)
     {
-        switch (stage->opcode)
-        {
-            case OPCODE_ADD:
-            {
-                int result = stage->result_buffer = stage->rs1_value + stage->rs2_value;
+        account_cycle(cpu, Fetch, stage->cause);
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
-            }
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            printf("Fetch: EMPTY\n");
+        }
+        return;
+    }
 
-            case OPCODE_SUB:
-            {
-                int result = stage->result_buffer = stage->rs1_value - stage->rs2_value;
+    /* This fetches new branch target instruction from next cycle */
+    if (cpu->fetch_from_next_cycle)
+    {
+        cpu->fetch_from_next_cycle = FALSE;
+        account_cycle(cpu, Fetch, CYCLE_FLUSH);
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            printf("Fetch: EMPTY\n");
+        }
+        return;
+    }
 
-                break;
-            }
+    /* A stalled fetch latch keeps its group, otherwise fetch a new one */
+    if (!stage->is_interrupted)
+    {
+        index = get_code_memory_index_from_pc(cpu->pc);
+        if (index < 0 || index >= cpu->code_memory_size)
+        {
+            stage->has_no_insn = 1;
+            stage->cause = CYCLE_EMPTY;
+            account_cycle(cpu, Fetch, CYCLE_EMPTY);
 
-            case OPCODE_MUL:
+            if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
             {
-                int result = stage->result_buffer = stage->rs1_value * stage->rs2_value;
-
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
+                printf("Fetch: EMPTY\n");
             }
+            return;
+        }
 
-            case OPCODE_DIV:
-            {
-                int result = stage->result_buffer = stage->rs1_value / stage->rs2_value;
+        latency = fetch_instruction(cpu, stage, index);
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
-            }
+        /* A wide fetch goes on sequentially, it ends at a branch predicted
+         * taken, at HALT and at the end of code memory. The group waits for
+         * its slowest instruction. */
+        cpu->num_lanes[Fetch] = 0;
+        prev = stage;
+        while (cpu->num_lanes[Fetch] < cpu->config.width - 1)
+        {
+            CPU_Stage *lane = &cpu->lane[Fetch][cpu->num_lanes[Fetch]];
+            int lane_latency;
 
-            case OPCODE_AND:
+            index = get_code_memory_index_from_pc(cpu->pc);
+            if ((prev->flags & INSN_IS_HALT) || prev->predicted_pc != prev->pc + 4
+                || index < 0 || index >= cpu->code_memory_size)
             {
-                int result = stage->result_buffer = stage->rs1_value & stage->rs2_value;
-
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
                 break;
             }
 
-            case OPCODE_OR:
+            lane_latency = fetch_instruction(cpu, lane, index);
+            if (lane_latency > latency)
             {
-                int result = stage->result_buffer = stage->rs1_value | stage->rs2_value;
-
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
+                latency = lane_latency;
             }
+            cpu->num_lanes[Fetch]++;
+            prev = lane;
+        }
 
-            case OPCODE_XOR:
-            {
-                int result = stage->result_buffer = stage->rs1_value ^ stage->rs2_value;
+        stage->busy = latency - 1;
+    }
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
-            }
+    if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+    {
+        print_group(cpu, "Fetch", Fetch);
+    }
 
-            case OPCODE_MOVC: 
-            {
-                int result = stage->result_buffer = stage->imm;
+    /* An I-cache miss keeps the instruction in Fetch for the rest of the miss
+     * latency */
+    if (stage->busy)
+    {
+        stage->busy--;
+        stage->is_interrupted = 1;
+        stage->cause = CYCLE_FETCH_STALL;
+        account_cycle(cpu, Fetch, CYCLE_FETCH_STALL);
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
-            }
+        if (cpu->profile)
+        {
+            cpu->profile[get_code_memory_index_from_pc(stage->pc)].fetch_cycles++;
+        }
+        return;
+    }
 
-            case OPCODE_LOAD:
-            {
-                stage->memory_address = stage->rs1_value + stage->imm;
-                break;
-            }
+    /* Copy data from fetch latch to decode latch if decode is free,
+     * else stall */
+    if (cpu->stage[DRF].has_no_insn)
+    {
+        stage->is_interrupted = 0;
+        copy_group(cpu, Fetch);
+        account_cycle(cpu, Fetch, CYCLE_USEFUL);
+    }
+    else
+    {
+        /* Held up for the same reason as Decode/RF */
+        stage->is_interrupted = 1;
+        stage->cause = cpu->stage[DRF].cause;
+        account_cycle(cpu, Fetch, stage->cause);
+    }
+}
 
-            case OPCODE_LOADP:
-            {
-                stage->memory_address = stage->rs1_value + stage->imm;
-                stage->rs1_value = stage->rs1_value + 4;
-                break;
-            }
+/*
+ * Checks whether the source registers and flags of 'stage' are valid, or can
+ * be forwarded, and reads them. Returns CYCLE_USEFUL if the instruction can
+ * issue, else the cause of the stall, with the register waited on in
+ * 'blocking_reg' for a data stall.
+ */
+static int
+issue_check(const APEX_CPU *cpu, const CPU_Stage *stage, int *rs1_value, int *rs2_value,
+            int *blocking_reg)
+{
+    if ((stage->flags & INSN_READS_RS1) && !read_source(cpu, stage->rs1, rs1_value))
+    {
+        *blocking_reg = stage->rs1;
+        return CYCLE_DATA_STALL;
+    }
 
-            case OPCODE_ADDL:
-            {
-                int result = stage->result_buffer = stage->rs1_value + stage->imm;
+    if ((stage->flags & INSN_READS_RS2) && !read_source(cpu, stage->rs2, rs2_value))
+    {
+        *blocking_reg = stage->rs2;
+        return CYCLE_DATA_STALL;
+    }
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
-            }
+    if ((stage->src_mask & (1u << CC_FLAGS_REG)) && !read_source(cpu, CC_FLAGS_REG, NULL))
+    {
+        return CYCLE_FLAG_STALL;
+    }
 
-            case OPCODE_SUBL:
-            {
-                int result = stage->result_buffer = stage->rs1_value - stage->imm;
+    if (cpu->config.parallel_units
+        && (cpu->reg_busy & stage->dst_mask & ~(1u << CC_FLAGS_REG)))
+    {
+        /* Units complete out of order, so a register has at most one writer
+         * in flight. The flags are set in Execute, in program order. */
+        *blocking_reg = __builtin_ctz(cpu->reg_busy & stage->dst_mask);
+        return CYCLE_DATA_STALL;
+    }
+    return CYCLE_USEFUL;
+}
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
-                
-                break;
-            }
+/*
+ * Latches the operands read by issue_check() and marks the destinations of
+ * 'stage' busy
+ */
+static void
+issue_instruction(APEX_CPU *cpu, CPU_Stage *stage, int rs1_value, int rs2_value)
+{
+    /* Read operands based on the instruction type */
+    if (stage->flags & INSN_READS_RS1)
+    {
+        stage->rs1_value = rs1_value;
+    }
 
-            // case OPCODE_JALR:
-            // {
-            //     int target_address = stage->rs1_value + stage->imm;
-            //     stage->result_buffer = stage->pc + 4;
-            //     cpu->fetch.pc = target_address;
-            //     break;
-            // }
+    if (stage->flags & INSN_READS_RS2)
+    {
+        stage->rs2_value = rs2_value;
+    }
 
-            case OPCODE_JALR:
-            {
-                int target_address = cpu->stage[EX].rs1_value + cpu->stage[EX].imm;
+    /* Destination registers and flags are invalid until writeback */
+    scoreboard_acquire(cpu, stage->dst_mask);
 
-                target_address = target_address & 0xFFFFFFFC;
+    /* Nothing after HALT is fetched */
+    if (stage->flags & INSN_IS_HALT)
+    {
+        cpu->stage[Fetch].has_no_insn = 1;
+        cpu->stage[Fetch].is_interrupted = 0;
+        cpu->stage[Fetch].cause = CYCLE_HALT_DRAIN;
+        cpu->num_lanes[Fetch] = 0;
+    }
+}
 
-                cpu->regs[cpu->stage[EX].rd] = cpu->stage[EX].pc + 4;
+/*
+ * Issues the lanes of the Decode/RF group that may go to Execute together
+ * with the instruction in the latch, which has issued already. In program
+ * order, a lane pairs if it does not depend on an earlier instruction of the
+ * group, its unit is free and single-cycle, and it is not HALT. There is an
+ * ALU per lane but one load/store unit, multiplier and divider. A group never
+ * holds a multi-cycle instruction and ends at a branch or jump, so a
+ * mispredict never squashes part of a group. Returns the number of lanes
+ * issued, with the reason the next lane did not pair in 'cause'.
+ */
+static int
+pair_lanes(APEX_CPU *cpu, int *cause)
+{
+    const CPU_Stage *stage = &cpu->stage[DRF];
+    uint32_t units = 1u << APEX_fu_class(stage->opcode);
+    int paired = 0;
 
-                cpu->stage[Fetch].pc = target_address;
-                cpu->stage[EX].is_interrupted = 1;
-                cpu->stage[MEM].is_interrupted = 1;
-                cpu->stage[WB].is_interrupted = 1;
+    *cause = CYCLE_STRUCTURAL_STALL;
 
-                break;
-            }
+    if ((stage->flags & (INSN_IS_BRANCH | INSN_IS_JUMP | INSN_IS_HALT))
+        || cpu->fu[APEX_fu_class(stage->opcode)].config.latency > 1)
+    {
+        return 0;
+    }
 
-            case OPCODE_STORE:
-            {
-                stage->memory_address = stage->rs2_value + stage->imm;
-                break;
-            }
-            
-            case OPCODE_STOREP:
-            {
-                stage->result_buffer = stage->rs1_value +4;
-                stage->memory_address = stage->rs2_value + stage->imm;
-                break;
-            }
+    while (paired < cpu->num_lanes[DRF])
+    {
+        CPU_Stage *lane = &cpu->lane[DRF][paired];
+        int fu = APEX_fu_class(lane->opcode);
+        int rs1_value = 0;
+        int rs2_value = 0;
+        int blocking_reg = -1;
+
+        if ((lane->flags & INSN_IS_HALT) || cpu->fu[fu].config.latency > 1
+            || (fu != FU_ALU && (units & (1u << fu))))
+        {
+            *cause = CYCLE_STRUCTURAL_STALL;
+            break;
+        }
 
-            case OPCODE_BZ:
-            {
-                if (cpu->cc_flags.Z) {
-                    stage->result_buffer = stage->pc + stage->imm;
-                    control_flow(cpu);
-                }
-                break;
-            }
+        /* The scoreboard already holds the destinations of the earlier
+         * instructions of the group, so a dependency on them is a stall */
+        *cause = issue_check(cpu, lane, &rs1_value, &rs2_value, &blocking_reg);
+        if (*cause != CYCLE_USEFUL)
+        {
+            break;
+        }
 
-            case OPCODE_BNZ:
-            {
-                if (!cpu->cc_flags.Z) {
-                    stage->result_buffer = stage->pc + stage->imm;
-                    control_flow(cpu);
-                }
-                break;
-            }
+        issue_instruction(cpu, lane, rs1_value, rs2_value);
+        units |= 1u << fu;
+        paired++;
+        *cause = CYCLE_STRUCTURAL_STALL;
 
-            case OPCODE_BP:
-            {
-                if (cpu->cc_flags.P) {
-                    stage->result_buffer = stage->pc + stage->imm;
-                    control_flow(cpu);
-                }
-                break;
-            }
+        if (lane->flags & (INSN_IS_BRANCH | INSN_IS_JUMP))
+        {
+            break;
+        }
+    }
+    return paired;
+}
 
-            case OPCODE_BNP:
-            {
-                if (!cpu->cc_flags.P) {
-                    stage->result_buffer = stage->pc + stage->imm;
-                    control_flow(cpu);
-                }
-                break;
-            }
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = &cpu->stage[DRF];
+    int rs1_value = 0;
+    int rs2_value = 0;
+    int cause = CYCLE_USEFUL;
+    int blocking_reg = -1;
+    int paired;
+    int left;
+
+    if (stage->has_no_insn)
+    {
+        account_cycle(cpu, DRF, stage->cause);
 
-            case OPCODE_BN:
-            {
-                if (cpu->cc_flags.N) {
-                    stage->result_buffer = stage->pc + stage->imm;
-                    control_flow(cpu);
-                }
-                break;
-            }
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            printf("Decode/RF: EMPTY\n");
+        }
+        return;
+    }
 
-            case OPCODE_BNN:
-            {
-                if (!cpu->cc_flags.N) {
-                    stage->result_buffer = stage->pc + stage->imm;
-                    control_flow(cpu);
-                }
-                break;
-            }
+    if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+    {
+        print_group(cpu, "Decode/RF", DRF);
+    }
 
-            case OPCODE_HALT:
-            {
-                stage->is_interrupted = 1;
-                break;
-            }
+    /* Stall until execute is free and the source registers and flags are
+     * valid, or can be forwarded */
+    if (!cpu->stage[EX].has_no_insn)
+    {
+        /* Held up for the same reason as Execute */
+        cause = cpu->stage[EX].cause;
+        if (cause == CYCLE_USEFUL)
+        {
+            cause = CYCLE_STRUCTURAL_STALL;
+        }
+    }
+    else
+    {
+        cause = issue_check(cpu, stage, &rs1_value, &rs2_value, &blocking_reg);
+    }
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
+    if (cause != CYCLE_USEFUL)
+    {
+        if (blocking_reg >= 0)
+        {
+            cpu->stats.reg_stall_cycles[blocking_reg]++;
+        }
 
-            case OPCODE_CMP:
-            {
-                int result = stage->rs1_value - stage->rs2_value;
+        if (cpu->profile)
+        {
+            cpu->profile[get_code_memory_index_from_pc(stage->pc)].stall_cycles++;
+        }
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
+        stage->is_interrupted = 1;
+        stage->cause = cause;
+        stage->stall_reg = blocking_reg >= 0 ? blocking_reg : STALL_REG_NONE;
+        account_cycle(cpu, DRF, cause);
+        return;
+    }
 
-                break;
-            }
+    issue_instruction(cpu, stage, rs1_value, rs2_value);
+    paired = pair_lanes(cpu, &cause);
+    cpu->stats.issue_groups[paired]++;
 
-            case OPCODE_JUMP:
-            {
-                int target_address = (stage->rs1_value + stage->imm) & (~0x3);
-                stage->pc = target_address;
-                break;
-            }
+    /* Copy the issued group from decode latch to execute latch */
+    stage->is_interrupted = 0;
+    cpu->stage[EX] = cpu->stage[DRF];
+    memcpy(cpu->lane[EX], cpu->lane[DRF], paired * sizeof(CPU_Stage));
+    cpu->num_lanes[EX] = paired;
 
-            case OPCODE_CML:
-            {
-                int result = stage->rs1_value - stage->imm;
+    /* Lanes that did not pair stay behind and issue from the next cycle,
+     * Fetch waits for them */
+    left = cpu->num_lanes[DRF] - paired;
+    if (left)
+    {
+        *stage = cpu->lane[DRF][paired];
+        memmove(cpu->lane[DRF], &cpu->lane[DRF][paired + 1], (left - 1) * sizeof(CPU_Stage));
+        cpu->num_lanes[DRF] = left - 1;
+        stage->is_interrupted = 0;
+        stage->cause = cause;
+    }
+    else
+    {
+        stage->has_no_insn = 1;
+    }
+    account_cycle(cpu, DRF, CYCLE_USEFUL);
+}
 
-                cpu->cc_flags.Z = (result == 0) ? 1 : 0;
-                cpu->cc_flags.N = (result < 0) ? 1 : 0;
-                cpu->cc_flags.P = (result > 0) ? 1 : 0;
+/*
+ * Index of the instruction in the units that goes to Memory this cycle, or
+ * -1 if none is done. In order only the oldest may go, with parallel units
+ * the writeback arbiter picks one of the finished instructions. HALT is never
+ * passed on ahead of an older instruction.
+ */
+static int
+pick_completion(const APEX_CPU *cpu)
+{
+    int pick = -1;
 
-                break;
-            }
-            default:
-            {
-                break;
-            }
-        }
+    if (!cpu->config.parallel_units)
+    {
+        return cpu->in_flight[0].busy ? -1 : 0;
+    }
 
-        /* Copy data from execute latch to memory latch*/
-        if (!stage->is_interrupted) {
-            cpu->stage[MEM] = cpu->stage[EX];
+    for (int i = 0; i < cpu->num_in_flight; ++i)
+    {
+        if (cpu->in_flight[i].busy || (i && (cpu->in_flight[i].flags & INSN_IS_HALT)))
+        {
+            continue;
         }
-        else {
-            cpu->stage[DRF].is_interrupted = 1;
-            cpu->stage[MEM].pc = 0000;
+
+        if (cpu->config.fu_arbiter == FU_ARBITER_OLDEST)
+        {
+            return i;
         }
 
-        if (ENABLE_DEBUG_MESSAGES) {
-            print_stage_content("Execute", stage);
+        if (pick < 0 || APEX_fu_class(cpu->in_flight[i].opcode)
+                            > APEX_fu_class(cpu->in_flight[pick].opcode))
+        {
+            pick = i;
         }
+    }
+    return pick;
+}
+
+/*
+ * Advances the instructions in the multi-cycle units by one cycle, one that
+ * is done moves on to Memory. Returns the class of the unit it left, or -1 if
+ * none left.
+ */
+static int
+advance_units(APEX_CPU *cpu)
+{
+    int released = -1;
+    int done;
 
-        if (strcmp(stage->opcode, "HALT") == 0) {
-            stage->is_interrupted = 1;
+    for (int i = 0; i < NUM_FU_CLASSES; ++i)
+    {
+        cpu->fu[i].occupancy += cpu->fu[i].in_flight;
+    }
+
+    if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+    {
+        for (int i = 0; i < cpu->num_in_flight; ++i)
+        {
+            print_stage_content("Execute (unit)", &cpu->in_flight[i]);
         }
     }
-    else
+
+    done = cpu->stage[MEM].has_no_insn ? pick_completion(cpu) : -1;
+    if (done >= 0)
     {
-        /* If current stage is interrupted then it is because of MUL and DIV
-        * stop stalling and copy data into the next stage
-        */
-        if (stage->is_interrupted && strcmp(stage->opcode, "MUL") == 0 && strcmp(stage->opcode, "DIV") == 0) {
-            if (ENABLE_COUNTING) {
-                cpu->code_memory_size++;
-            }
-            stage->is_interrupted = 0;
-            cpu->stage[DRF].is_interrupted = 0;
-            cpu->stage[MEM] = cpu->stage[EX];
+        released = APEX_fu_class(cpu->in_flight[done].opcode);
+        cpu->fu[released].in_flight--;
 
-            if (ENABLE_DEBUG_MESSAGES) {
-                print_stage_content("Execute", stage);
-            }
+        /* Younger instructions wait behind it for the Memory latch */
+        cpu->stage[MEM] = cpu->in_flight[done];
+        cpu->stage[MEM].cause = CYCLE_STRUCTURAL_STALL;
+        cpu->num_lanes[MEM] = 0;
+
+        cpu->num_in_flight--;
+        memmove(&cpu->in_flight[done], &cpu->in_flight[done + 1],
+                (cpu->num_in_flight - done) * sizeof(cpu->in_flight[0]));
+    }
+
+    for (int i = 0; i < cpu->num_in_flight; ++i)
+    {
+        if (cpu->in_flight[i].busy)
+        {
+            cpu->in_flight[i].busy--;
         }
     }
+    return released;
 }
 
 /*
- * Memory Stage of APEX Pipeline
+ * Executes one instruction of the EX group, resolves its branch or jump and
+ * flushes Fetch and Decode/RF on a mispredict
+ */
+static void
+execute_instruction(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    int next_pc;
+    int taken;
+
+    cpu->fu[APEX_fu_class(stage->opcode)].operations++;
+
+    taken = APEX_isa_execute(stage, &cpu->cc_flags);
+    next_pc = taken ? stage->memory_address : stage->pc + 4;
+
+    if (stage->flags & (INSN_IS_BRANCH | INSN_IS_JUMP))
+    {
+        cpu->btb.resolved++;
+        APEX_btb_update(&cpu->btb, stage->pc, taken, stage->memory_address);
+    }
+
+    /* Fetch went down the wrong path, flush it */
+    if (next_pc != stage->predicted_pc)
+    {
+        control_flow(cpu, stage, next_pc);
+    }
+}
+
+/*
+ * Execute Stage of APEX Pipeline
  *
  * Note: You are free to edit this function according to your implementation
  */
 static void
-APEX_memory(APEX_CPU *cpu)
+APEX_execute(APEX_CPU *cpu)
 {
-    CPU_Stage* stage = &cpu->stage[MEM];
-    if (!stage->has_no_insn && !stage->is_interrupted)
+    CPU_Stage *stage = &cpu->stage[EX];
+    APEX_FU *fu;
+    int released = -1;
+
+    if (cpu->num_in_flight)
     {
-        switch (stage->opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_MOVC:
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_JALR:
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_BN:
-            case OPCODE_BNN:
-            case OPCODE_HALT:
-            case OPCODE_NOP:
-            case OPCODE_CMP:
-            case OPCODE_JUMP:
-            case OPCODE_CML:
-            {
-                /* No work */
-                break;
-            }
+        released = advance_units(cpu);
+    }
 
-            case OPCODE_LOAD:
-            case OPCODE_LOADP:
-            {
-                stage->result_buffer = cpu->data_memory[stage->memory_address];
-                break;
-            }
+    if (stage->has_no_insn)
+    {
+        account_cycle(cpu, EX, stage->cause);
 
-            case OPCODE_STORE:
-            case OPCODE_STOREP:
-            {
-                cpu->data_memory[stage->memory_address] = stage->rs1_value;
-                break;
-            }
-            default:
-            {
-                break;
-            }
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            printf("Execute: EMPTY\n");
         }
+        return;
+    }
 
-        /* Copy data from memory latch to writeback latch*/
-        cpu->stage[WB] = cpu->stage[MEM];
+    fu = &cpu->fu[APEX_fu_class(stage->opcode)];
 
-        if (ENABLE_DEBUG_MESSAGES) {
-            print_stage_content("Memory", stage);
-        }
+    /* A multi-cycle instruction, always alone in its group, waits in the
+     * latch until its unit is free */
+    if (fu->config.latency > 1
+        && !APEX_fu_available(fu, released == APEX_fu_class(stage->opcode)))
+    {
+        fu->stall_cycles++;
+        stage->cause = CYCLE_STRUCTURAL_STALL;
+        account_cycle(cpu, EX, CYCLE_STRUCTURAL_STALL);
 
-        if (strcmp(stage->opcode, "HALT") == 0) {
-            stage->is_interrupted = 1;
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            print_stage_content("Execute", stage);
         }
+        return;
     }
-    else
+
+    /* A group held up by Memory has been executed already. Its instructions
+     * are independent of each other, apart from a write-after-write which
+     * Writeback applies in program order. */
+    if (!stage->is_interrupted)
     {
-        if (ENABLE_DEBUG_MESSAGES)
+        execute_instruction(cpu, stage);
+
+        for (int i = 0; i < cpu->num_lanes[EX]; ++i)
         {
-            printf("Memory: Empty\n");
+            execute_instruction(cpu, &cpu->lane[EX][i]);
         }
     }
+
+    if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+    {
+        print_group(cpu, "Execute", EX);
+    }
+
+    /* The rest of a multi-cycle operation is done by the unit, the latch is
+     * free from the next cycle */
+    if (fu->config.latency > 1)
+    {
+        CPU_Stage *slot = &cpu->in_flight[cpu->num_in_flight++];
+
+        *slot = *stage;
+        slot->busy = fu->config.latency - 2;
+        fu->in_flight++;
+        stage->has_no_insn = 1;
+        account_cycle(cpu, EX, CYCLE_USEFUL);
+        return;
+    }
+
+    /* Copy data from execute latch to memory latch if memory is free and,
+     * unless the units complete out of order, no older instruction is still in
+     * a unit, else stall for the same reason as Memory. HALT always waits for
+     * the units to drain. */
+    if (!cpu->stage[MEM].has_no_insn
+        || (cpu->num_in_flight
+            && (!cpu->config.parallel_units || (stage->flags & INSN_IS_HALT))))
+    {
+        stage->is_interrupted = 1;
+        stage->cause = cpu->stage[MEM].has_no_insn ? CYCLE_STRUCTURAL_STALL
+                                                   : cpu->stage[MEM].cause;
+        account_cycle(cpu, EX, stage->cause);
+        return;
+    }
+
+    stage->is_interrupted = 0;
+    copy_group(cpu, EX);
+    stage->has_no_insn = 1;
+    account_cycle(cpu, EX, CYCLE_USEFUL);
 }
 
 /*
- * Writeback Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Performs the data memory access of one instruction of the MEM group.
+ * Returns the cycles it takes, or 0 if another core holds the bank of a
+ * shared memory in this cycle.
  */
 static int
-APEX_writeback(APEX_CPU *cpu)
+access_memory(APEX_CPU *cpu, CPU_Stage *stage)
 {
-    CPU_Stage* stage = &cpu->stage[WB];
-    if (!stage->has_no_insn && !stage->is_interrupted)
+    int latency = 1;
+
+    if (!(stage->flags & (INSN_IS_LOAD | INSN_IS_STORE)))
     {
-        /* Write result to register file based on instruction type */
-        switch (stage->opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_MOVC:
-            case OPCODE_LOAD:
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_JUMP:
-            {
-                cpu->regs[stage->rd] = stage->result_buffer;
-                break;
-            }
+        return latency;
+    }
 
-            case OPCODE_LOADP:
-            {
-                cpu->regs[stage->rd] = stage->result_buffer;
-                cpu->stage->rs1_value = stage->result_buffer;
-                break;
-            }
+    if (!APEX_cpu_mem_claim(cpu, stage->memory_address))
+    {
+        return 0;
+    }
 
-            case OPCODE_JALR:
-            {
-                cpu->regs[stage->rd] = stage->result_buffer;
-                cpu->regs[stage->pc] = stage->result_buffer;
-                break;
-            }
+    if (stage->flags & INSN_IS_LOAD)
+    {
+        stage->result_buffer = APEX_cpu_mem_read(cpu, stage->memory_address);
+    }
+    else
+    {
+        APEX_cpu_mem_write(cpu, stage->memory_address, stage->rs1_value);
+    }
 
-            case OPCODE_STORE:
-            case OPCODE_STOREP:
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_BN:
-            case OPCODE_BNN:
-            case OPCODE_HALT:
-            case OPCODE_NOP:
-            case OPCODE_CMP:
-            {
-                break;
-            }
+    if (cpu->dcache.lines)
+    {
+        latency = APEX_cache_access(&cpu->dcache, stage->memory_address,
+                                    stage->flags & INSN_IS_STORE);
+    }
 
-            case OPCODE_CML:
-            {
-                int src1_value = stage->rs1_value;
-                int literal = stage->imm;
-            }
-        }
-        
-        if ((stage->rd != cpu->stage[MEM].rd || strcmp(cpu->stage[MEM].opcode, "STORE") == 0 || strcmp(cpu->stage[MEM].opcode, "BZ") == 0 ||
-                strcmp(cpu->stage[MEM].opcode, "BNZ") == 0 || strcmp(cpu->stage[MEM].opcode, "JUMP") == 0 || strcmp(cpu->stage[MEM].opcode, "BUBBLE") == 0) &&
-                (stage->rd != cpu->stage[EX].rd || strcmp(cpu->stage[EX].opcode, "STORE") == 0 || strcmp(cpu->stage[EX].opcode, "BZ") == 0 ||
-                strcmp(cpu->stage[EX].opcode, "BNZ") == 0 || strcmp(cpu->stage[EX].opcode, "JUMP") == 0 || strcmp(cpu->stage[EX].opcode, "BUBBLE") == 0)) {
-            cpu->regChecking[stage->rd] = 1;
+    if (cpu->profile)
+    {
+        cpu->profile[get_code_memory_index_from_pc(stage->pc)].mem_accesses++;
+    }
+    return latency;
+}
+
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_memory(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = &cpu->stage[MEM];
+    int granted = TRUE;
+
+    if (stage->has_no_insn)
+    {
+        account_cycle(cpu, MEM, stage->cause);
+
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            printf("Memory: EMPTY\n");
         }
+        return;
+    }
+
+    /* Data memory is accessed in the first cycle, a data cache miss then
+     * keeps the group in Memory for the rest of the miss latency. A group
+     * has at most one load or store, so a group whose access lost its shared
+     * memory bank simply tries again in the next cycle. */
+    if (!stage->is_interrupted)
+    {
+        int latency = access_memory(cpu, stage);
 
-        /* Update Z-flag */
-        if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "MUL") == 0 ||
-            strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "DIV") == 0 ||
-            strcmp(stage->opcode, "CMP") == 0 || strcmp(stage->opcode, "CML") == 0)
+        for (int i = 0; i < cpu->num_lanes[MEM]; ++i)
         {
-            /*  Check whether there is an instruction (ADD or SUB or MUL or DIV or ADDL or SUBL or CMP or CML) in EX or MEM stage
-            *  If so, do NOT make zero_flag valid
-            */
-            if (strcmp(cpu->stage[MEM].opcode, "ADD") != 0 && strcmp(cpu->stage[MEM].opcode, "SUB") != 0 && strcmp(cpu->stage[MEM].opcode, "MUL") != 0 &&
-                strcmp(cpu->stage[MEM].opcode, "ADDL") != 0 && strcmp(cpu->stage[MEM].opcode, "SUBL") != 0 && strcmp(cpu->stage[MEM].opcode, "DIV") != 0 &&
-                strcmp(cpu->stage[MEM].opcode, "CMP") != 0 && strcmp(cpu->stage[MEM].opcode, "CML") != 0 &&
-                strcmp(cpu->stage[EX].opcode, "ADD") != 0 && strcmp(cpu->stage[EX].opcode, "SUB") != 0 && strcmp(cpu->stage[EX].opcode, "MUL") != 0 &&
-                strcmp(cpu->stage[EX].opcode, "ADDL") != 0 && strcmp(cpu->stage[EX].opcode, "SUBL") != 0 && strcmp(cpu->stage[EX].opcode, "DIV") != 0 &&
-                strcmp(cpu->stage[EX].opcode, "CMP") != 0 && strcmp(cpu->stage[EX].opcode, "CML") != 0) {
-
-                cpu->zero_flag_valid = 1;
-                if (stage->result_buffer == 0) {
-                    cpu->cc_flags.Z = 1;
-                }
-                else {
-                    cpu->cc_flags.Z = 0;
-                }
+            int lane_latency = access_memory(cpu, &cpu->lane[MEM][i]);
+
+            if (!lane_latency || (latency && lane_latency > latency))
+            {
+                latency = lane_latency;
             }
         }
 
-        cpu->insn_completed++;
+        granted = latency > 0;
+        stage->busy = granted ? latency - 1 : 0;
+    }
+
+    if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+    {
+        print_group(cpu, "Memory", MEM);
+    }
+
+    if (!granted)
+    {
+        stage->cause = CYCLE_MEMORY_STALL;
+        account_cycle(cpu, MEM, CYCLE_MEMORY_STALL);
+        return;
+    }
+
+    if (stage->busy)
+    {
+        stage->busy--;
+        stage->is_interrupted = 1;
+        stage->cause = CYCLE_MEMORY_STALL;
+        account_cycle(cpu, MEM, CYCLE_MEMORY_STALL);
+        return;
+    }
+
+    /* Copy data from memory latch to writeback latch */
+    stage->is_interrupted = 0;
+    copy_group(cpu, MEM);
+    stage->has_no_insn = 1;
+    account_cycle(cpu, MEM, CYCLE_USEFUL);
+}
+
+/*
+ * Writes the results of one instruction of the WB group back and retires it
+ */
+static void
+writeback_instruction(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    /* Write results to register file based on instruction type */
+    if (stage->flags & INSN_WRITES_RD)
+    {
+        cpu->regs[stage->rd] = stage->result_buffer;
+    }
+
+    if (stage->flags & INSN_WRITES_RS1)
+    {
+        cpu->regs[stage->rs1] = stage->rs1_value;
+    }
+
+    if (stage->flags & INSN_WRITES_RS2)
+    {
+        cpu->regs[stage->rs2] = stage->rs2_value;
+    }
+
+    scoreboard_release(cpu, stage->dst_mask);
+
+    cpu->insn_completed++;
+    cpu->stats.opcode_retired[stage->opcode]++;
+
+    if (cpu->profile)
+    {
+        cpu->profile[get_code_memory_index_from_pc(stage->pc)].executed++;
+    }
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_writeback(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = &cpu->stage[WB];
+
+    if (stage->has_no_insn)
+    {
+        account_cycle(cpu, WB, stage->cause);
 
-        if (ENABLE_DEBUG_MESSAGES)
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
         {
-            print_stage_content("Writeback", stage);
+            printf("Writeback: EMPTY\n");
         }
+        return 0;
+    }
 
-        if (stage->opcode == OPCODE_HALT)
-        {
-            /* Stop the APEX simulator */
-            return TRUE;
-        }
+    /* The group retires in program order */
+    writeback_instruction(cpu, stage);
 
-        if (stage->opcode == OPCODE_NOP)
-        {
-            cpu->stage[Fetch] = cpu->stage[WB];
-        }
+    for (int i = 0; i < cpu->num_lanes[WB]; ++i)
+    {
+        writeback_instruction(cpu, &cpu->lane[WB][i]);
     }
-    else
+    account_cycle(cpu, WB, CYCLE_USEFUL);
+
+    if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("Writeback: EMPTY\n");
-        
-        }
+        print_group(cpu, "Writeback", WB);
+    }
+
+    stage->has_no_insn = 1;
+
+    /* HALT is never paired, it retires alone */
+    if (stage->flags & INSN_IS_HALT)
+    {
+        /* Stop the APEX simulator */
+        return TRUE;
     }
     return 0;
 }
 
+static void
+print_btb_stats(const APEX_CPU *cpu)
+{
+    const APEX_BTB *btb = &cpu->btb;
+
+    printf("APEX_CPU: BTB %d entries %d-way, lookups = %llu hits = %llu "
+           "branches = %llu mispredicts = %llu flush cycles = %llu\n",
+           btb->num_sets * btb->ways, btb->ways,
+           (unsigned long long)btb->lookups, (unsigned long long)btb->hits,
+           (unsigned long long)btb->resolved, (unsigned long long)btb->mispredicts,
+           (unsigned long long)btb->flush_cycles);
+}
+
 int print_state_of_architectural_register_file(APEX_CPU *cpu)
 {
     printf("\n |============= STATE OF ARCHITECTURAL REGISTER FILE =============|\n");
@@ -1042,7 +1159,7 @@ int print_state_of_architectural_register_file(APEX_CPU *cpu)
     for (int i = 0; i < ((sizeof(cpu->regs) / sizeof(cpu->regs[0]))); ++i)
     {
         char status[10];
-        if (cpu->regChecking[i])
+        if (cpu->reg_busy & (1u << i))
         {
             strcpy(status, "NOT VALID");
         }
@@ -1060,7 +1177,7 @@ int print_state_of_data_memory(APEX_CPU *cpu)
     printf("\n |================ STATE OF DATA MEMORY ================|\n");
     for (int i = 0; i < 250; i++)
     {
-        printf("| \t MEM[%d] \t | \t Data Value = %d \t \n", i, cpu->data_memory[i]);
+        printf("| \t MEM[%d] \t | \t Data Value = %d \t \n", i, APEX_cpu_mem_read(cpu, i));
     }
     return 0;
 }
@@ -1072,7 +1189,7 @@ int APEX_cpu_display_simulate_show_mem(APEX_CPU *cpu, int cycEntred, const char
         printf("\n display   ####################################################################   display\n");
         for (int i = 0; i < cycEntred; cycEntred--)
         {
-            if (ENABLE_DEBUG_MESSAGES)
+            if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
             {
                 printf("--------------------------------------------\n");
                 int clockCycle = cpu->clock + 1;
@@ -1102,7 +1219,7 @@ int APEX_cpu_display_simulate_show_mem(APEX_CPU *cpu, int cycEntred, const char
         printf("\nsimulate   $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$    simulate\n");
         for (int i = 0; i < cycEntred; --cycEntred)
         {
-            if (ENABLE_DEBUG_MESSAGES)
+            if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
             {
                 printf("--------------------------------------------\n");
                 int clockCycle = cpu->clock + 1;
@@ -1125,7 +1242,7 @@ int APEX_cpu_display_simulate_show_mem(APEX_CPU *cpu, int cycEntred, const char
 
         while (TRUE)
         {
-            if (ENABLE_DEBUG_MESSAGES)
+            if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
             {
                 printf("--------------------------------------------\n");
                 int clockCycle = cpu->clock + 1;
@@ -1147,7 +1264,7 @@ int APEX_cpu_display_simulate_show_mem(APEX_CPU *cpu, int cycEntred, const char
 
             print_reg_file(cpu);
 
-            if (cpu->single_step)
+            if (cpu->config.single_step)
             {
                 printf("Press any key to advance CPU Clock or <q> to quit:\n");
                 scanf("%c", &user_prompt_val);
@@ -1187,46 +1304,28 @@ int APEX_cpu_display_simulate_show_mem(APEX_CPU *cpu, int cycEntred, const char
     return 0;
 }
 
-int
-control_flow(APEX_CPU* cpu)
+/*
+ * Fills the configuration with the defaults used by the command line front
+ * end
+ */
+void
+APEX_config_init(APEX_Config *config)
 {
-    CPU_Stage* stage = &cpu->stage[EX];
-    int diff = stage->result_buffer - stage->pc;
-
-    if (strcmp(cpu->stage[DRF].opcode, "BZ") == 0 || strcmp(cpu->stage[DRF].opcode, "BNZ") == 0 || strcmp(cpu->stage[DRF].opcode, "BP") == 0 ||
-        strcmp(cpu->stage[DRF].opcode, "BNP") == 0 || strcmp(cpu->stage[DRF].opcode, "BN") == 0 || strcmp(cpu->stage[DRF].opcode, "BNN") == 0) {
-        cpu->stage[DRF].pc = 0000;
-    }
-
-    if (strcmp(cpu->stage[Fetch].opcode, "BZ") == 0 || strcmp(cpu->stage[Fetch].opcode, "BNZ") == 0 || strcmp(cpu->stage[Fetch].opcode, "BP") == 0 ||
-        strcmp(cpu->stage[Fetch].opcode, "BNP") == 0 || strcmp(cpu->stage[Fetch].opcode, "BN") == 0 || strcmp(cpu->stage[Fetch].opcode, "BNN") == 0) {
-        cpu->stage[Fetch].pc = 0000;
-        cpu->stage[Fetch].is_interrupted = 1;
-    }
-
-  cpu->pc = stage->result_buffer;
-
-  if (ENABLE_COUNTING) {
-    if (diff == 4) {
-      cpu->code_memory_size += 2;
-    }
-
-    if (diff == 8) {
-      cpu->code_memory_size++;
-    }
-
-    if (diff > 12) {
-      int temp = (diff - 12) / 4;
-      cpu->code_memory_size -= temp;
-    }
-
-    if (stage->imm < 0) {
-      diff = abs(diff);
-      int temp = diff / 4;
-      cpu->code_memory_size = cpu->code_memory_size + temp + 3;
-    }
-  }
-  return 0;
+    memset(config, 0, sizeof(*config));
+    config->max_cycles = INT_MAX;
+    config->trace = TRUE;
+    config->display = TRUE;
+    config->single_step = ENABLE_SINGLE_STEP;
+    config->counting = FALSE;
+    config->btb_entries = 16;
+    config->btb_ways = 2;
+    APEX_cache_config_init(&config->icache);
+    APEX_cache_config_init(&config->dcache);
+    APEX_fu_config_init(config->fu);
+    config->width = 1;
+    config->engine = APEX_ENGINE_INORDER;
+    config->rob_size = 32;
+    config->iq_size = 16;
 }
 
 /*
@@ -1235,69 +1334,92 @@ control_flow(APEX_CPU* cpu)
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename, const char* function, const int cycles)
+APEX_cpu_create(const char *filename, const APEX_Config *config)
 {
-    int i;
     APEX_CPU *cpu;
 
-    if (!filename && !function && !cycles)
+    if (!filename || !config)
     {
         return NULL;
     }
 
-    cpu = malloc(sizeof(*cpu));
+    cpu = calloc(1, sizeof(*cpu));
 
     if (!cpu)
     {
         return NULL;
     }
 
-    if (strcmp(function, "simulate") == 0) {
-        ENABLE_DISPLAY = 1;
+    cpu->config = *config;
+
+    if (config->width < 1 || config->width > APEX_MAX_WIDTH)
+    {
+        free(cpu);
+        return NULL;
+    }
+
+    for (int i = 0; i < NUM_FU_CLASSES; ++i)
+    {
+        if (config->fu[i].latency < 1 || config->fu[i].latency > FU_MAX_LATENCY)
+        {
+            free(cpu);
+            return NULL;
+        }
+        cpu->fu[i].config = config->fu[i];
+    }
+
+    if (APEX_btb_init(&cpu->btb, config->btb_entries, config->btb_ways))
+    {
+        free(cpu);
+        return NULL;
     }
-    else {
-        ENABLE_DISPLAY = 1;
+
+    if (APEX_cache_init(&cpu->icache, &config->icache)
+        || APEX_cache_init(&cpu->dcache, &config->dcache))
+    {
+        APEX_btb_free(&cpu->btb);
+        APEX_cache_free(&cpu->icache);
+        free(cpu);
+        return NULL;
     }
 
     /* Initialize PC, Registers and all pipeline stages */
     cpu->pc = 4000;
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
-    // cpu->fetch.is_interrupted = 0;
-    // cpu->decode.is_interrupted = 0;
-    // cpu->execute.is_interrupted = 0;
-    // cpu->memory.is_interrupted = 0;
-    // cpu->writeback.is_interrupted = 0;
+    APEX_mem_init(&cpu->memory, config->hugepages);
 
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
 
-    /* Making Z flag invalid for the first branch instruction */
-    cpu->zero_flag_valid = 1;
-
     cpu->clock = 1;
 
     if (!cpu->code_memory)
     {
+        APEX_btb_free(&cpu->btb);
+        APEX_cache_free(&cpu->icache);
+        APEX_cache_free(&cpu->dcache);
         free(cpu);
         return NULL;
     }
 
-    if (ENABLE_DEBUG_MESSAGES)
+    if (config->profile)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode", "rd", "rs1", "rs2", "imm");
+        cpu->profile = calloc(cpu->code_memory_size, sizeof(*cpu->profile));
+        if (!cpu->profile)
+        {
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+    }
 
-        for (int i = 0; i < cpu->code_memory_size; ++i)
+    if (config->engine == APEX_ENGINE_OOO)
+    {
+        cpu->ooo = APEX_ooo_create(config);
+        if (!cpu->ooo)
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+            APEX_cpu_stop(cpu);
+            return NULL;
         }
     }
 
@@ -1306,11 +1428,316 @@ APEX_cpu_init(const char *filename, const char* function, const int cycles)
         cpu->stage[i].has_no_insn = 1;
     }
 
-    ENABLE_COUNTING = 0;
-    cpu->code_memory_size = cycles;
     return cpu;
 }
 
+APEX_CPU *
+APEX_cpu_init(const char *filename, const char* function, const int cycles)
+{
+    APEX_Config config;
+
+    if (!filename && !function && !cycles)
+    {
+        return NULL;
+    }
+
+    APEX_config_init(&config);
+    config.max_cycles = cycles;
+    return APEX_cpu_create(filename, &config);
+}
+
+/*
+ * Prints the code memory loaded from the input file
+ */
+void
+APEX_cpu_print_code_memory(const APEX_CPU *cpu)
+{
+    fprintf(stderr,
+            "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+            cpu->code_memory_size);
+    fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+    fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+    printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode", "rd", "rs1", "rs2", "imm");
+
+    for (int i = 0; i < cpu->code_memory_size; ++i)
+    {
+        printf("%-9s %-9d %-9d %-9d %-9d\n", get_opcode_str(cpu->code_memory[i].opcode),
+               cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+               cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+    }
+}
+
+/*
+ * First cycle in which stepping the cpu can change any of its state, or
+ * INT_MAX if no cycle will. Every stage takes one cycle, so while anything is
+ * in flight this is the current cycle. Stages with a longer latency report the
+ * cycle they complete in here.
+ */
+static int
+next_event_cycle(const APEX_CPU *cpu)
+{
+    /* Bubbles still moving through the empty latches change the counters */
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        if (!cpu->stage[i].has_no_insn || cpu->stage[i].cause != cpu->stage[Fetch].cause)
+        {
+            return cpu->clock;
+        }
+    }
+
+    if (cpu->fetch_from_next_cycle || cpu->num_in_flight)
+    {
+        return cpu->clock;
+    }
+
+    /* Drained without a HALT, fetch ran off the end of code memory */
+    return INT_MAX;
+}
+
+/*
+ * Advances the clock over the cycles in which nothing can change, up to the
+ * cycle limit. Stepping through them would leave the same state, apart from
+ * the trace, so this is only done with the trace off.
+ */
+static void
+skip_idle_cycles(APEX_CPU *cpu)
+{
+    int next = next_event_cycle(cpu);
+
+    if (next > cpu->config.max_cycles)
+    {
+        next = cpu->config.max_cycles;
+    }
+
+    if (next > cpu->clock)
+    {
+        /* Each skipped cycle is the same bubble in every stage */
+        for (int i = 0; i < NUM_STAGES; ++i)
+        {
+            cpu->stats.stage_cycles[i][cpu->stage[i].cause] += next - cpu->clock;
+        }
+        cpu->clock = next;
+    }
+}
+
+/* State compared across a cycle to find out whether only busy counters
+ * moved */
+typedef struct Pipeline_Snapshot
+{
+    CPU_Stage stage[NUM_STAGES];
+    CPU_Stage lane[NUM_STAGES][APEX_MAX_WIDTH - 1];
+    int num_lanes[NUM_STAGES];
+    CPU_Stage in_flight[FU_MAX_IN_FLIGHT];
+    int num_in_flight;
+    int pc;
+    int fetch_from_next_cycle;
+} Pipeline_Snapshot;
+
+/*
+ * Returns TRUE if a stage is working off a multi-cycle latency
+ */
+static int
+pipeline_busy(const APEX_CPU *cpu)
+{
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        if (!cpu->stage[i].has_no_insn && cpu->stage[i].busy)
+        {
+            return TRUE;
+        }
+    }
+
+    for (int i = 0; i < cpu->num_in_flight; ++i)
+    {
+        if (cpu->in_flight[i].busy)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void
+take_snapshot(const APEX_CPU *cpu, Pipeline_Snapshot *snapshot)
+{
+    memcpy(snapshot->stage, cpu->stage, sizeof(snapshot->stage));
+    memcpy(snapshot->lane, cpu->lane, sizeof(snapshot->lane));
+    memcpy(snapshot->num_lanes, cpu->num_lanes, sizeof(snapshot->num_lanes));
+    memcpy(snapshot->in_flight, cpu->in_flight, cpu->num_in_flight * sizeof(cpu->in_flight[0]));
+    snapshot->num_in_flight = cpu->num_in_flight;
+    snapshot->pc = cpu->pc;
+    snapshot->fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+}
+
+/*
+ * Called after a cycle that started from 'before'. If the only change in that
+ * cycle was busy stages and units counting down, every cycle until the first
+ * of them finishes repeats it exactly: each stage accounts its latch's cause
+ * again, a stalled Decode/RF counts one more stall, a Fetch waiting on the
+ * I-cache one more fetch stall and an instruction waiting for its unit one
+ * more unit stall. Those cycles are accounted and the clock advanced without
+ * stepping, up to the cycle limit.
+ */
+static void
+skip_busy_cycles(APEX_CPU *cpu, Pipeline_Snapshot *before)
+{
+    long long limit = (long long)cpu->config.max_cycles - cpu->clock + 1;
+    long long cycles = limit;
+    CPU_Stage *drf = &cpu->stage[DRF];
+    CPU_Stage *ex = &cpu->stage[EX];
+
+    if (before->pc != cpu->pc || before->fetch_from_next_cycle != cpu->fetch_from_next_cycle
+        || before->num_in_flight != cpu->num_in_flight)
+    {
+        return;
+    }
+
+    for (int i = 0; i < before->num_in_flight; ++i)
+    {
+        CPU_Stage *expected = &before->in_flight[i];
+
+        if (expected->busy)
+        {
+            expected->busy--;
+            if (expected->busy < cycles)
+            {
+                cycles = expected->busy;
+            }
+        }
+    }
+
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        CPU_Stage *expected = &before->stage[i];
+
+        if (!expected->has_no_insn && expected->busy)
+        {
+            expected->busy--;
+            if (expected->busy < cycles)
+            {
+                cycles = expected->busy;
+            }
+        }
+    }
+
+    /* CPU_Stage has no padding, so equal latches compare equal */
+    if (cycles <= 0 || memcmp(before->stage, cpu->stage, sizeof(before->stage))
+        || memcmp(before->lane, cpu->lane, sizeof(before->lane))
+        || memcmp(before->num_lanes, cpu->num_lanes, sizeof(before->num_lanes))
+        || memcmp(before->in_flight, cpu->in_flight, cpu->num_in_flight * sizeof(cpu->in_flight[0])))
+    {
+        return;
+    }
+
+    for (int i = 0; i < cpu->num_in_flight; ++i)
+    {
+        if (cpu->in_flight[i].busy)
+        {
+            cpu->in_flight[i].busy -= cycles;
+        }
+    }
+
+    for (int i = 0; i < NUM_FU_CLASSES; ++i)
+    {
+        cpu->fu[i].occupancy += cycles * cpu->fu[i].in_flight;
+    }
+
+    /* Only an instruction waiting for its unit stays in Execute unexecuted */
+    if (!ex->has_no_insn && !ex->is_interrupted)
+    {
+        cpu->fu[APEX_fu_class(ex->opcode)].stall_cycles += cycles;
+    }
+
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        CPU_Stage *stage = &cpu->stage[i];
+
+        cpu->stats.stage_cycles[i][stage->cause] += cycles;
+        if (!stage->has_no_insn && stage->busy)
+        {
+            stage->busy -= cycles;
+
+            if (i == Fetch && cpu->profile)
+            {
+                cpu->profile[get_code_memory_index_from_pc(stage->pc)].fetch_cycles += cycles;
+            }
+        }
+    }
+
+    if (!drf->has_no_insn && drf->is_interrupted)
+    {
+        if (drf->cause == CYCLE_DATA_STALL)
+        {
+            cpu->stats.reg_stall_cycles[drf->stall_reg] += cycles;
+        }
+
+        if (cpu->profile)
+        {
+            cpu->profile[get_code_memory_index_from_pc(drf->pc)].stall_cycles += cycles;
+        }
+    }
+
+    cpu->clock += cycles;
+}
+
+/*
+ * Simulates one clock cycle of APEX Pipeline, stages run from Writeback back
+ * to Fetch so each latch is consumed before it is refilled
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu)
+{
+    if (cpu->halted)
+    {
+        return TRUE;
+    }
+
+    if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+    {
+        printf("--------------------------------------------\n");
+        printf("Clock Cycle #: %d\n", cpu->clock);
+        printf("--------------------------------------------\n");
+    }
+
+    if (cpu->ooo)
+    {
+        if (APEX_ooo_cycle(cpu))
+        {
+            /* Halt committed */
+            cpu->halted = TRUE;
+            return TRUE;
+        }
+
+        cpu->clock++;
+        return FALSE;
+    }
+
+    if (APEX_writeback(cpu))
+    {
+        /* Halt in writeback stage */
+        cpu->halted = TRUE;
+        return TRUE;
+    }
+
+    APEX_memory(cpu);
+    APEX_execute(cpu);
+    APEX_decode(cpu);
+    APEX_fetch(cpu);
+
+    cpu->clock++;
+    return FALSE;
+}
+
+void
+APEX_cpu_stall(APEX_CPU *cpu)
+{
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        cpu->stats.stage_cycles[i][CYCLE_MEMORY_STALL]++;
+    }
+    cpu->clock++;
+}
+
 /*
  * APEX CPU simulation loop
  *
@@ -1319,9 +1746,14 @@ APEX_cpu_init(const char *filename, const char* function, const int cycles)
 void
 APEX_cpu_run(APEX_CPU *cpu)
 {
-    while (cpu->clock <= cpu->code_memory_size)
+    int skip = cpu->config.skip_idle && !cpu->ooo
+               && !(ENABLE_DEBUG_MESSAGES && cpu->config.trace);
+    Pipeline_Snapshot before;
+    int busy;
+
+    while (cpu->clock <= cpu->config.max_cycles)
     {
-        if (ENABLE_COUNTING)
+        if (cpu->config.counting)
         {
             /* All the instructions committed, so exit */
             if (cpu->insn_completed == cpu->code_memory_size) {
@@ -1329,49 +1761,72 @@ APEX_cpu_run(APEX_CPU *cpu)
                 break;
             }
         }
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
-        }
 
-        if (APEX_writeback(cpu))
+        busy = FALSE;
+        if (skip)
         {
-            /* Halt in writeback stage */
-            printf("Positive Flag: %d\nNegative Flag: %d\nZero Flag: %d\n", cpu->cc_flags.P, cpu->cc_flags.N, cpu->cc_flags.Z);
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            break;
-        }
-
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
+            skip_idle_cycles(cpu);
 
-        /*print_reg_file(cpu);
+            busy = pipeline_busy(cpu);
+            if (busy)
+            {
+                take_snapshot(cpu, &before);
+            }
+        }
 
-        if (cpu->single_step)
+        if (APEX_cpu_step(cpu))
         {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
-
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
+            if (cpu->config.display)
             {
-                printf("Positive Flag: %d\nNegative Flag: %d\nZero Flag: %d\n", cpu->positive_flag, cpu->negative_flag, cpu->zero_flag);
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
+                printf("Positive Flag: %d\nNegative Flag: %d\nZero Flag: %d\n", cpu->cc_flags.P, cpu->cc_flags.N, cpu->cc_flags.Z);
+                printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
             }
-        }*/
+            break;
+        }
 
-        cpu->clock++;
+        if (busy)
+        {
+            skip_busy_cycles(cpu, &before);
+        }
     }
 
-    if (ENABLE_DISPLAY) {
-        print_state_of_architectural_register_file(cpu);
+    if (cpu->config.display) {
+        APEX_cpu_print_report(cpu);
         print_state_of_data_memory(cpu);
     }
-    return 0;
+}
+
+void
+APEX_cpu_print_report(APEX_CPU *cpu)
+{
+    if (cpu->memory.pages || cpu->memory.faults)
+    {
+        printf("APEX_CPU: Sparse data memory pages = %llu faults = %llu\n",
+               (unsigned long long)cpu->memory.pages,
+               (unsigned long long)cpu->memory.faults);
+    }
+    print_btb_stats(cpu);
+    if (cpu->ooo)
+    {
+        APEX_ooo_print_stats(cpu->ooo, cpu->clock);
+    }
+    APEX_fu_print_stats(cpu->fu, cpu->clock);
+    if (cpu->icache.lines)
+    {
+        APEX_cache_print_stats(&cpu->icache, "I-cache");
+    }
+    if (cpu->dcache.lines)
+    {
+        APEX_cache_print_stats(&cpu->dcache, "D-cache");
+    }
+    APEX_stats_print(&cpu->stats, cpu->config.width);
+    print_state_of_architectural_register_file(cpu);
+}
+
+void
+APEX_cpu_print_data_memory(APEX_CPU *cpu)
+{
+    print_state_of_data_memory(cpu);
 }
 
 /*
@@ -1382,6 +1837,12 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
+    APEX_btb_free(&cpu->btb);
+    APEX_cache_free(&cpu->icache);
+    APEX_cache_free(&cpu->dcache);
+    APEX_mem_free(&cpu->memory);
+    APEX_ooo_free(cpu->ooo);
+    free(cpu->profile);
     free(cpu->code_memory);
     free(cpu);
 }
\ No newline at end of file
@@ -9,93 +9,320 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
-#include "apex_macros.h"
-/*struct flagCheck
-{
-  int flagIsUsed;
-  int flagIsNotUsed;
-  int isRegValEmpty;
-} flagCheck;*/
+#include <stddef.h>
+#include <stdint.h>
 
-enum
-{
-  Fetch,
-  DRF,
-  EX,
-  MEM,
-  WB,
-  NUM_STAGES
-};
+#include "apex_btb.h"
+#include "apex_cache.h"
+#include "apex_fu.h"
+#include "apex_macros.h"
+#include "apex_mem.h"
+#include "apex_profile.h"
+#include "apex_stats.h"
 
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
-    int opcode;
-    int rd;
-    int rs1;
-    int rs2;
+    uint8_t opcode;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint16_t flags; /* INSN_* class bits */
     int imm;
+    uint32_t src_mask; /* Scoreboard bits read, see CC_FLAGS_REG */
+    uint32_t dst_mask; /* Scoreboard bits written */
 } APEX_Instruction;
 
-/* Model of CPU stage latch */
+/* Model of CPU stage latch
+ *
+ * Packed without padding so that a latch transfer copies 48 bytes: values
+ * first, then the opcode id and register indices as bytes. The mnemonic is
+ * not stored, it is looked up with get_opcode_str() for display only. */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
-    int opcode;
-    int rs1;
-    int rs2;
-    int rd;
     int imm;
     int rs1_value;
     int rs2_value;
     int result_buffer;
     int memory_address;
-    int has_no_insn;
-    int is_interrupted;
+    int predicted_pc; /* Pc fetched after this instruction, checked in EX */
+    uint32_t src_mask;
+    uint32_t dst_mask;
+    uint16_t flags;
+    uint16_t busy; /* Cycles the stage still needs for this instruction */
+    uint8_t opcode;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t rd;
+    uint8_t has_no_insn;
+    uint8_t is_interrupted;
+    uint8_t cause; /* CYCLE_* cause of a stall, or of the bubble when empty */
+    uint8_t stall_reg; /* Register a data stall in Decode/RF waits on, or
+                        * STALL_REG_NONE */
 } CPU_Stage;
 
+/* CPU_Stage.stall_reg of a stall that does not wait on a register */
+#define STALL_REG_NONE 0xff
+
+/* Condition code flags */
+typedef struct APEX_Flags
+{
+    int Z;  // Zero flag
+    int N;  // Negative flag
+    int P;  // Positive flag
+} APEX_Flags;
+
+/* Timing models, see APEX_Config.engine */
+#define APEX_ENGINE_INORDER 0 /* Five stage in-order pipeline */
+#define APEX_ENGINE_OOO 1     /* Out-of-order engine, see apex_ooo.h */
+
+/* Run time configuration of one APEX_CPU. Every option lives here rather
+ * than in process-global state, so any number of cpus can run side by side
+ * in one process, on any threads. */
+typedef struct APEX_Config
+{
+    int max_cycles;  /* Cycles simulated by APEX_cpu_run() */
+    int trace;       /* Print stage contents every cycle */
+    int display;     /* Print final state at the end of APEX_cpu_run() */
+    int single_step; /* Wait for user input after every cycle */
+    int counting;    /* Stop once code_memory_size insns retired */
+    int btb_entries; /* BTB size, 0 disables branch prediction */
+    int btb_ways;    /* BTB associativity */
+    int forwarding;  /* Bypass EX and MEM results to Decode/RF */
+    int skip_idle;   /* Let APEX_cpu_run() jump over idle cycles */
+    int profile;     /* Keep per-instruction counters, see apex_profile.h */
+    int hugepages;   /* Back the sparse data memory with huge pages */
+    APEX_Cache_Config icache; /* Instruction cache timing in Fetch */
+    APEX_Cache_Config dcache; /* Data cache timing in Memory */
+    APEX_FU_Config fu[NUM_FU_CLASSES]; /* Execute latency of each class */
+    int parallel_units; /* Units complete out of order */
+    int fu_arbiter;     /* FU_ARBITER_*, order of the units into Memory */
+    int width;          /* Instructions per cycle, 1 to APEX_MAX_WIDTH */
+    int engine;         /* APEX_ENGINE_* timing model */
+    int rob_size;       /* Reorder buffer entries of the OoO engine */
+    int iq_size;        /* Issue queue entries of the OoO engine */
+} APEX_Config;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
     int pc;                        /* Current program counter */
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
+    int insn_fastforwarded;        /* Instructions run by the functional model */
     int regs[REG_FILE_SIZE];       /* Integer register file */
     int code_memory_size;          /* Number of instruction in the input file */
     APEX_Instruction* code_memory; /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
-    int single_step;               /* Wait for user input after every cycle */
-    int zero_flag_valid;
+    APEX_Config config;            /* Run time configuration of this cpu */
+    int halted;                    /* HALT was retired */
     int previous_ins_pc;
     int fetch_from_next_cycle;
-    int regChecking[REG_FILE_SIZE];
+
+    /* Scoreboard: bit i of reg_busy is set while register i (or the flags,
+     * bit CC_FLAGS_REG) has in-flight writers, reg_pending counts them */
+    uint32_t reg_busy;
+    uint8_t reg_pending[REG_FILE_SIZE + 1];
 
     /* Array of 5 CPU_stage */
     CPU_Stage stage[5];
 
-    struct {
-        int Z;  // Zero flag
-        int N;  // Negative flag
-        int P;  // Positive flag
-    } cc_flags;
-
-    // /* Pipeline stages */
-    // CPU_Stage fetch;
-    // CPU_Stage decode;
-    // CPU_Stage execute;
-    // CPU_Stage memory;
-    // CPU_Stage writeback;
+    /* Younger instructions of a superscalar group, they travel with the
+     * instruction in stage[i] and are only valid while it is. An empty
+     * stage or a width of 1 has no lanes. */
+    CPU_Stage lane[NUM_STAGES][APEX_MAX_WIDTH - 1];
+    int num_lanes[NUM_STAGES];
+
+    APEX_Flags cc_flags;
+
+    /* Functional units of Execute. Instructions of a multi-cycle unit leave
+     * the EX latch after their first cycle and wait in 'in_flight', oldest
+     * first, until they reach Memory. Unless config.parallel_units is set
+     * only the oldest may leave. */
+    APEX_FU fu[NUM_FU_CLASSES];
+    CPU_Stage in_flight[FU_MAX_IN_FLIGHT];
+    int num_in_flight;
+
+    /* Branch Target Buffer consulted by Fetch, trained by Execute */
+    APEX_BTB btb;
+
+    /* Cache timing models of the Fetch and Memory stages */
+    APEX_Cache icache;
+    APEX_Cache dcache;
+
+    /* Performance counters, see apex_stats.h */
+    APEX_Stats stats;
+
+    /* Per code memory entry counters, NULL unless config.profile is set */
+    APEX_Profile_Entry *profile;
+
+    /* State of the out-of-order engine, NULL with the in-order pipeline. The
+     * pipeline latches above are not used then. */
+    struct APEX_OoO *ooo;
+
+    /* Data memory of an APEX_System, shared with the other cores, or NULL.
+     * 'memory' and 'data_memory' below are not used when it is set. On a
+     * host-parallel system the accesses go through 'mailbox' instead. */
+    APEX_Shared_Memory *shared;
+    APEX_Mailbox *mailbox;
+    int core_id;
+
+    /* Data memory above the inline array, see apex_mem.h */
+    APEX_Memory memory;
+
+    /* Data memory is kept last so that the per-cycle state above stays
+     * together at the start of the structure */
+    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
 } APEX_CPU;
 
-APEX_Instruction *create_code_memory(const char *filename, int *size);
+/* Converts the PC(4000 series) into array index for code memory
+ *
+ * Note: You are not supposed to edit this function
+ */
+static inline int
+get_code_memory_index_from_pc(const int pc)
+{
+    return (pc - 4000) / 4;
+}
+
+/* Value a producer in flight will write to 'reg', in the order writeback
+ * applies them: a post-increment after the result */
+static inline int
+APEX_stage_result(const CPU_Stage *producer, int reg)
+{
+    if ((producer->flags & INSN_WRITES_RS2) && producer->rs2 == reg)
+    {
+        return producer->rs2_value;
+    }
+
+    if ((producer->flags & INSN_WRITES_RS1) && producer->rs1 == reg)
+    {
+        return producer->rs1_value;
+    }
+
+    return producer->result_buffer;
+}
+
+/* Data memory accesses. The inline array is the fast path, only addresses
+ * outside of it go to the sparse paged memory. */
+static inline int
+APEX_cpu_mem_read(APEX_CPU *cpu, int address)
+{
+    if (cpu->shared)
+    {
+        return cpu->mailbox ? APEX_mailbox_read(cpu->mailbox, cpu->shared, address)
+                            : APEX_shared_read(cpu->shared, address);
+    }
+
+    if ((unsigned)address < DATA_MEMORY_SIZE)
+    {
+        return cpu->data_memory[address];
+    }
+    return APEX_mem_read(&cpu->memory, address);
+}
+
+static inline void
+APEX_cpu_mem_write(APEX_CPU *cpu, int address, int value)
+{
+    if (cpu->shared)
+    {
+        if (cpu->mailbox)
+        {
+            APEX_mailbox_write(cpu->mailbox, address, value, cpu->clock);
+            return;
+        }
+        APEX_shared_write(cpu->shared, address, value);
+        return;
+    }
+
+    if ((unsigned)address < DATA_MEMORY_SIZE)
+    {
+        cpu->data_memory[address] = value;
+        return;
+    }
+    APEX_mem_write(&cpu->memory, address, value);
+}
+
+/* Arbitrates for the shared memory bank of 'address' in the current cycle.
+ * Returns FALSE if the access has to wait for the next cycle, a cpu with a
+ * data memory of its own always goes ahead. Through a mailbox only the
+ * accesses of the cpu itself are arbitrated here. */
+static inline int
+APEX_cpu_mem_claim(APEX_CPU *cpu, int address)
+{
+    if (!cpu->shared)
+    {
+        return TRUE;
+    }
+
+    if (cpu->mailbox ? !APEX_mailbox_claim(cpu->mailbox, cpu->shared, address, cpu->clock)
+                     : !APEX_shared_claim(cpu->shared, address, cpu->clock))
+    {
+        cpu->stats.bank_conflicts++;
+        return FALSE;
+    }
+    cpu->stats.shared_accesses++;
+    return TRUE;
+}
+
+/*
+ * libapex API
+ *
+ * A cpu is created from an input file and a configuration, advanced one
+ * cycle at a time with APEX_cpu_step() or until HALT or the cycle limit
+ * with APEX_cpu_run(), and released with APEX_cpu_stop(). Functions only
+ * touch the cpu passed to them, separate cpus may be used concurrently from
+ * different threads.
+ */
+
+/* Fills 'config' with defaults: trace and display on, no cycle limit, a
+ * 16 entry, 2-way BTB, no forwarding, no caches, single-cycle functional
+ * units and a width of 1 on the in-order pipeline. The OoO engine has a 32
+ * entry reorder buffer and a 16 entry issue queue. */
+void APEX_config_init(APEX_Config *config);
+
+/* Loads 'filename' and returns a cpu with pc at 4000 and empty pipeline,
+ * or NULL if the file can not be loaded or the BTB, cache, functional
+ * unit, width or engine configuration is invalid */
+APEX_CPU *APEX_cpu_create(const char *filename, const APEX_Config *config);
+
+/* Same as APEX_cpu_create() with the default configuration and a limit of
+ * 'cycles', kept for the command line front end */
 APEX_CPU *APEX_cpu_init(const char *filename, const char* function, const int cycles);
+
+/* Simulates one clock cycle. Returns TRUE once HALT has been retired, the
+ * cpu does not advance any further after that. */
+int APEX_cpu_step(APEX_CPU *cpu);
+
+/* Steps the cpu until HALT retires or config.max_cycles is reached */
 void APEX_cpu_run(APEX_CPU *cpu);
+
+/* Spends one clock cycle with every stage held, accounted as a memory
+ * stall */
+void APEX_cpu_stall(APEX_CPU *cpu);
+
+/* Frees the cpu, its code memory, data memory pages, BTB, caches and
+ * profile */
 void APEX_cpu_stop(APEX_CPU *cpu);
-int fetch(APEX_CPU* cpu);
-int decode(APEX_CPU* cpu);
-int execute(APEX_CPU* cpu);
-int memory(APEX_CPU* cpu);
-int writeback(APEX_CPU* cpu);
+
+void APEX_cpu_print_code_memory(const APEX_CPU *cpu);
+
+/* Prints the end of run report of APEX_cpu_run(): the unit, cache and
+ * pipeline counters and the register file. APEX_cpu_print_data_memory()
+ * prints the start of data memory. */
+void APEX_cpu_print_report(APEX_CPU *cpu);
+void APEX_cpu_print_data_memory(APEX_CPU *cpu);
+
+/* Prints the instruction in 'stage' as a line of the cycle trace */
+void APEX_cpu_print_stage(const char *name, const CPU_Stage *stage);
+
+int APEX_cpu_fastforward(APEX_CPU *cpu, const int count);
+int APEX_cpu_checkpoint_save(const APEX_CPU *cpu, const char *filename);
+int APEX_cpu_checkpoint_restore(APEX_CPU *cpu, const char *filename);
+int APEX_cpu_profile_write(const APEX_CPU *cpu, const char *asm_file, const char *filename);
+
+/* Parser, see file_parser.c */
+APEX_Instruction *create_code_memory(const char *filename, int *size);
+const char *get_opcode_str(const int opcode);
+int set_opcode_str(const char *str, size_t len);
 #endif
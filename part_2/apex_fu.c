@@ -0,0 +1,133 @@
+/*
+ * apex_fu.c
+ * Contains the functional units of the Execute stage
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_fu.h"
+#include "apex_macros.h"
+
+static const char *const fu_names[NUM_FU_CLASSES] = {
+    "alu", "lsu", "mul", "div",
+};
+
+void
+APEX_fu_config_init(APEX_FU_Config config[NUM_FU_CLASSES])
+{
+    for (int i = 0; i < NUM_FU_CLASSES; ++i)
+    {
+        config[i].latency = 1;
+        config[i].pipelined = TRUE;
+    }
+}
+
+int
+APEX_fu_config_parse(APEX_FU_Config config[NUM_FU_CLASSES], const char *spec)
+{
+    char *copy = strdup(spec);
+    char *saveptr;
+    int ret = 0;
+
+    if (!copy)
+    {
+        return -1;
+    }
+
+    for (char *token = strtok_r(copy, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr))
+    {
+        char *value = strchr(token, '=');
+        char *mode;
+        char *end;
+        long latency;
+        int fu;
+
+        if (!value)
+        {
+            ret = -1;
+            break;
+        }
+        *value++ = '\0';
+
+        for (fu = 0; fu < NUM_FU_CLASSES && strcmp(token, fu_names[fu]); ++fu)
+            ;
+
+        mode = strchr(value, ':');
+        if (mode)
+        {
+            *mode++ = '\0';
+        }
+
+        errno = 0;
+        latency = strtol(value, &end, 10);
+        if (fu == NUM_FU_CLASSES || end == value || *end != '\0' || errno
+            || latency < 1 || latency > FU_MAX_LATENCY
+            || (mode && strcmp(mode, "pipelined") && strcmp(mode, "unpipelined")))
+        {
+            ret = -1;
+            break;
+        }
+
+        config[fu].latency = (int)latency;
+        config[fu].pipelined = !mode || strcmp(mode, "unpipelined");
+    }
+
+    free(copy);
+    return ret;
+}
+
+int
+APEX_fu_class(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_LOAD:
+        case OPCODE_STORE:
+        case OPCODE_LOADP:
+        case OPCODE_STOREP:
+        {
+            return FU_LSU;
+        }
+
+        case OPCODE_MUL:
+        {
+            return FU_MUL;
+        }
+
+        case OPCODE_DIV:
+        {
+            return FU_DIV;
+        }
+
+        default:
+        {
+            return FU_ALU;
+        }
+    }
+}
+
+void
+APEX_fu_print_stats(const APEX_FU fu[NUM_FU_CLASSES], int cycles)
+{
+    for (int i = 0; i < NUM_FU_CLASSES; ++i)
+    {
+        if (fu[i].config.latency == 1)
+        {
+            continue;
+        }
+
+        printf("APEX_CPU: %s unit %d cycles %s, operations = %llu stall cycles = %llu "
+               "average in flight = %.3f\n",
+               fu_names[i], fu[i].config.latency,
+               fu[i].config.pipelined ? "pipelined" : "unpipelined",
+               (unsigned long long)fu[i].operations, (unsigned long long)fu[i].stall_cycles,
+               cycles > 0 ? (double)fu[i].occupancy / cycles : 0.0);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * apex_fu.h
+ * Contains the functional units of the Execute stage
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FU_H_
+#define _APEX_FU_H_
+
+#include <stdint.h>
+
+/* Operation classes, each class runs on its own functional unit. With the
+ * priority writeback arbiter a higher class goes to Memory first. */
+enum
+{
+    FU_ALU, /* Arithmetic, logic and branch target */
+    FU_LSU, /* Memory address of loads and stores */
+    FU_MUL,
+    FU_DIV,
+    NUM_FU_CLASSES
+};
+
+/* Which finished instruction of the units goes to Memory first when the
+ * units complete out of order */
+#define FU_ARBITER_OLDEST 0   /* Program order */
+#define FU_ARBITER_PRIORITY 1 /* Highest class, then program order */
+
+/* Longest latency a unit can be configured with */
+#define FU_MAX_LATENCY 32
+
+/* Instructions that can be inside the multi-cycle units at once, enough for
+ * every unit to be full */
+#define FU_MAX_IN_FLIGHT (NUM_FU_CLASSES * FU_MAX_LATENCY)
+
+typedef struct APEX_FU_Config
+{
+    int latency;   /* Cycles from entering Execute to entering Memory */
+    int pipelined; /* Accepts an operation every cycle, else one at a time */
+} APEX_FU_Config;
+
+typedef struct APEX_FU
+{
+    APEX_FU_Config config;
+    int in_flight; /* Operations past their first cycle in the unit */
+
+    /* Statistics */
+    uint64_t operations;
+    uint64_t occupancy;    /* Operations in the unit summed over the cycles */
+    uint64_t stall_cycles; /* Cycles an instruction waited in Execute for it */
+} APEX_FU;
+
+/* Fills 'config' with single-cycle pipelined units for every class */
+void APEX_fu_config_init(APEX_FU_Config config[NUM_FU_CLASSES]);
+
+/* Updates 'config' from a "class=cycles[:pipelined|:unpipelined],..." list
+ * with the classes alu, lsu, mul and div. Returns 0, or -1 on an unknown class or
+ * a latency out of range. */
+int APEX_fu_config_parse(APEX_FU_Config config[NUM_FU_CLASSES], const char *spec);
+
+/* Returns the FU_* class that executes 'opcode' */
+int APEX_fu_class(int opcode);
+
+/* Returns TRUE if 'fu' can take an operation this cycle. 'released' is TRUE
+ * if an operation left the unit this cycle, which an unpipelined unit only
+ * gets back from the next cycle. */
+static inline int
+APEX_fu_available(const APEX_FU *fu, int released)
+{
+    if (fu->config.pipelined)
+    {
+        return fu->in_flight < fu->config.latency;
+    }
+    return !fu->in_flight && !released;
+}
+
+/* Prints the counters of the units with a latency above one cycle */
+void APEX_fu_print_stats(const APEX_FU fu[NUM_FU_CLASSES], int cycles);
+
+#endif
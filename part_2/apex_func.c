@@ -0,0 +1,124 @@
+/*
+ * apex_func.c
+ * Contains the functional (architectural only) model of APEX cpu, used to
+ * fast-forward a program before the pipeline model takes over
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_isa.h"
+#include "apex_macros.h"
+
+/*
+ * Returns TRUE if a latch or functional unit holds an instruction. Before the
+ * first cycle the Fetch latch is armed but holds nothing.
+ */
+static int
+pipeline_holds_insn(const APEX_CPU *cpu)
+{
+    if (cpu->num_in_flight || (cpu->ooo && cpu->clock > 1))
+    {
+        return TRUE;
+    }
+
+    for (int i = 0; i < NUM_STAGES; ++i)
+    {
+        if (!cpu->stage[i].has_no_insn && (i != Fetch || cpu->clock > 1))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Executes up to 'count' instructions from cpu->pc, one at a time, updating
+ * only the architectural state: pc, registers, flags and data memory. No
+ * latch, scoreboard or clock is touched, so the pipeline model can continue
+ * cycle accurately from the resulting state.
+ *
+ * Stops early in front of HALT, which is left for the pipeline to retire, or
+ * when pc leaves code memory. Returns the number of instructions executed, or
+ * -1 if the pipeline already holds instructions, such as after a checkpoint
+ * restore: they would be run twice or lost.
+ */
+int
+APEX_cpu_fastforward(APEX_CPU *cpu, const int count)
+{
+    const APEX_Instruction *current_ins;
+    CPU_Stage insn;
+    int executed = 0;
+    int index;
+
+    if (pipeline_holds_insn(cpu))
+    {
+        return -1;
+    }
+
+    while (executed < count)
+    {
+        index = get_code_memory_index_from_pc(cpu->pc);
+        if (index < 0 || index >= cpu->code_memory_size)
+        {
+            break;
+        }
+
+        current_ins = &cpu->code_memory[index];
+        if (current_ins->flags & INSN_IS_HALT)
+        {
+            break;
+        }
+
+        insn.pc = cpu->pc;
+        insn.opcode = current_ins->opcode;
+        insn.flags = current_ins->flags;
+        insn.rd = current_ins->rd;
+        insn.rs1 = current_ins->rs1;
+        insn.rs2 = current_ins->rs2;
+        insn.imm = current_ins->imm;
+        insn.rs1_value = cpu->regs[insn.rs1];
+        insn.rs2_value = cpu->regs[insn.rs2];
+
+        if (APEX_isa_execute(&insn, &cpu->cc_flags))
+        {
+            cpu->pc = insn.memory_address;
+        }
+        else
+        {
+            cpu->pc += 4;
+        }
+
+        if (insn.flags & INSN_IS_LOAD)
+        {
+            insn.result_buffer = APEX_cpu_mem_read(cpu, insn.memory_address);
+        }
+        else if (insn.flags & INSN_IS_STORE)
+        {
+            APEX_cpu_mem_write(cpu, insn.memory_address, insn.rs1_value);
+        }
+
+        if (insn.flags & INSN_WRITES_RD)
+        {
+            cpu->regs[insn.rd] = insn.result_buffer;
+        }
+
+        if (insn.flags & INSN_WRITES_RS1)
+        {
+            cpu->regs[insn.rs1] = insn.rs1_value;
+        }
+
+        if (insn.flags & INSN_WRITES_RS2)
+        {
+            cpu->regs[insn.rs2] = insn.rs2_value;
+        }
+
+        executed++;
+    }
+
+    cpu->insn_fastforwarded += executed;
+    return executed;
+}
@@ -0,0 +1,435 @@
+/*
+ * apex_isa.c
+ * Contains APEX instruction semantics shared by the pipeline models
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_cpu.h"
+#include "apex_isa.h"
+#include "apex_macros.h"
+
+/* Register arithmetic wraps around in two's complement like the hardware.
+ * It is done in unsigned, because signed overflow is undefined in C. */
+static inline int
+wrap_add(int a, int b)
+{
+    return (int)((unsigned int)a + (unsigned int)b);
+}
+
+static inline int
+wrap_sub(int a, int b)
+{
+    return (int)((unsigned int)a - (unsigned int)b);
+}
+
+static inline int
+wrap_mul(int a, int b)
+{
+    return (int)((unsigned int)a * (unsigned int)b);
+}
+
+/* Division by zero yields zero and INT_MIN / -1 wraps to INT_MIN, neither
+ * traps the host */
+static inline int
+wrap_div(int a, int b)
+{
+    if (b == 0)
+    {
+        return 0;
+    }
+    if (b == -1)
+    {
+        return wrap_sub(0, a);
+    }
+    return a / b;
+}
+
+#ifdef APEX_EXEC_SWITCH
+
+/*
+ * Reference engine, one switch over the opcode
+ */
+static int
+execute_insn(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    int taken = FALSE;
+
+    switch (stage->opcode)
+    {
+        case OPCODE_ADD:
+        {
+            stage->result_buffer = wrap_add(stage->rs1_value, stage->rs2_value);
+            break;
+        }
+
+        case OPCODE_SUB:
+        {
+            stage->result_buffer = wrap_sub(stage->rs1_value, stage->rs2_value);
+            break;
+        }
+
+        case OPCODE_MUL:
+        {
+            stage->result_buffer = wrap_mul(stage->rs1_value, stage->rs2_value);
+            break;
+        }
+
+        case OPCODE_DIV:
+        {
+            stage->result_buffer = wrap_div(stage->rs1_value, stage->rs2_value);
+            break;
+        }
+
+        case OPCODE_AND:
+        {
+            stage->result_buffer = stage->rs1_value & stage->rs2_value;
+            break;
+        }
+
+        case OPCODE_OR:
+        {
+            stage->result_buffer = stage->rs1_value | stage->rs2_value;
+            break;
+        }
+
+        case OPCODE_XOR:
+        {
+            stage->result_buffer = stage->rs1_value ^ stage->rs2_value;
+            break;
+        }
+
+        case OPCODE_MOVC:
+        {
+            stage->result_buffer = stage->imm;
+            break;
+        }
+
+        case OPCODE_LOAD:
+        {
+            stage->memory_address = wrap_add(stage->rs1_value, stage->imm);
+            break;
+        }
+
+        case OPCODE_LOADP:
+        {
+            stage->memory_address = wrap_add(stage->rs1_value, stage->imm);
+            stage->rs1_value = wrap_add(stage->rs1_value, 4);
+            break;
+        }
+
+        case OPCODE_ADDL:
+        {
+            stage->result_buffer = wrap_add(stage->rs1_value, stage->imm);
+            break;
+        }
+
+        case OPCODE_SUBL:
+        {
+            stage->result_buffer = wrap_sub(stage->rs1_value, stage->imm);
+            break;
+        }
+
+        case OPCODE_STORE:
+        {
+            stage->memory_address = wrap_add(stage->rs2_value, stage->imm);
+            break;
+        }
+
+        case OPCODE_STOREP:
+        {
+            stage->memory_address = wrap_add(stage->rs2_value, stage->imm);
+            stage->rs2_value = wrap_add(stage->rs2_value, 4);
+            break;
+        }
+
+        case OPCODE_BZ:
+        {
+            taken = flags->Z;
+            break;
+        }
+
+        case OPCODE_BNZ:
+        {
+            taken = !flags->Z;
+            break;
+        }
+
+        case OPCODE_BP:
+        {
+            taken = flags->P;
+            break;
+        }
+
+        case OPCODE_BNP:
+        {
+            taken = !flags->P;
+            break;
+        }
+
+        case OPCODE_BN:
+        {
+            taken = flags->N;
+            break;
+        }
+
+        case OPCODE_BNN:
+        {
+            taken = !flags->N;
+            break;
+        }
+
+        case OPCODE_CMP:
+        {
+            stage->result_buffer = wrap_sub(stage->rs1_value, stage->rs2_value);
+            break;
+        }
+
+        case OPCODE_CML:
+        {
+            stage->result_buffer = wrap_sub(stage->rs1_value, stage->imm);
+            break;
+        }
+
+        case OPCODE_JUMP:
+        {
+            stage->memory_address = wrap_add(stage->rs1_value, stage->imm) & (~0x3);
+            taken = TRUE;
+            break;
+        }
+
+        case OPCODE_JALR:
+        {
+            stage->memory_address = wrap_add(stage->rs1_value, stage->imm) & (~0x3);
+            stage->result_buffer = stage->pc + 4;
+            taken = TRUE;
+            break;
+        }
+
+        case OPCODE_HALT:
+        case OPCODE_NOP:
+        default:
+        {
+            break;
+        }
+    }
+
+    return taken;
+}
+
+#else
+
+/* Each handler computes one opcode and returns TRUE for a taken control
+ * transfer. Flag updates and branch targets are common to all opcodes and
+ * are done once in APEX_isa_execute() */
+typedef int (*APEX_Exec_Handler)(CPU_Stage *stage, const APEX_Flags *flags);
+
+static int
+exec_add(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = wrap_add(stage->rs1_value, stage->rs2_value);
+    return FALSE;
+}
+
+static int
+exec_sub(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = wrap_sub(stage->rs1_value, stage->rs2_value);
+    return FALSE;
+}
+
+static int
+exec_mul(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = wrap_mul(stage->rs1_value, stage->rs2_value);
+    return FALSE;
+}
+
+static int
+exec_div(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = wrap_div(stage->rs1_value, stage->rs2_value);
+    return FALSE;
+}
+
+static int
+exec_and(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = stage->rs1_value & stage->rs2_value;
+    return FALSE;
+}
+
+static int
+exec_or(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = stage->rs1_value | stage->rs2_value;
+    return FALSE;
+}
+
+static int
+exec_xor(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = stage->rs1_value ^ stage->rs2_value;
+    return FALSE;
+}
+
+static int
+exec_movc(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = stage->imm;
+    return FALSE;
+}
+
+static int
+exec_load(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->memory_address = wrap_add(stage->rs1_value, stage->imm);
+    return FALSE;
+}
+
+static int
+exec_loadp(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->memory_address = wrap_add(stage->rs1_value, stage->imm);
+    stage->rs1_value = wrap_add(stage->rs1_value, 4);
+    return FALSE;
+}
+
+static int
+exec_addl(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = wrap_add(stage->rs1_value, stage->imm);
+    return FALSE;
+}
+
+static int
+exec_subl(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = wrap_sub(stage->rs1_value, stage->imm);
+    return FALSE;
+}
+
+static int
+exec_store(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->memory_address = wrap_add(stage->rs2_value, stage->imm);
+    return FALSE;
+}
+
+static int
+exec_storep(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->memory_address = wrap_add(stage->rs2_value, stage->imm);
+    stage->rs2_value = wrap_add(stage->rs2_value, 4);
+    return FALSE;
+}
+
+static int
+exec_bz(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return flags->Z;
+}
+
+static int
+exec_bnz(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return !flags->Z;
+}
+
+static int
+exec_bp(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return flags->P;
+}
+
+static int
+exec_bnp(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return !flags->P;
+}
+
+static int
+exec_bn(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return flags->N;
+}
+
+static int
+exec_bnn(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return !flags->N;
+}
+
+static int
+exec_cml(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->result_buffer = wrap_sub(stage->rs1_value, stage->imm);
+    return FALSE;
+}
+
+static int
+exec_jump(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->memory_address = wrap_add(stage->rs1_value, stage->imm) & (~0x3);
+    return TRUE;
+}
+
+static int
+exec_jalr(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    stage->memory_address = wrap_add(stage->rs1_value, stage->imm) & (~0x3);
+    stage->result_buffer = stage->pc + 4;
+    return TRUE;
+}
+
+static int
+exec_nop(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return FALSE;
+}
+
+/* Handler table indexed by numeric opcode, CMP shares the SUB handler */
+static const APEX_Exec_Handler exec_handlers[NUM_OPCODES] = {
+    [OPCODE_ADD] = exec_add,     [OPCODE_SUB] = exec_sub,
+    [OPCODE_MUL] = exec_mul,     [OPCODE_DIV] = exec_div,
+    [OPCODE_AND] = exec_and,     [OPCODE_OR] = exec_or,
+    [OPCODE_XOR] = exec_xor,     [OPCODE_MOVC] = exec_movc,
+    [OPCODE_LOAD] = exec_load,   [OPCODE_STORE] = exec_store,
+    [OPCODE_BZ] = exec_bz,       [OPCODE_BNZ] = exec_bnz,
+    [OPCODE_HALT] = exec_nop,    [OPCODE_ADDL] = exec_addl,
+    [OPCODE_SUBL] = exec_subl,   [OPCODE_NOP] = exec_nop,
+    [OPCODE_LOADP] = exec_loadp, [OPCODE_STOREP] = exec_storep,
+    [OPCODE_CML] = exec_cml,     [OPCODE_CMP] = exec_sub,
+    [OPCODE_BP] = exec_bp,       [OPCODE_BNP] = exec_bnp,
+    [OPCODE_BN] = exec_bn,       [OPCODE_BNN] = exec_bnn,
+    [OPCODE_JUMP] = exec_jump,   [OPCODE_JALR] = exec_jalr,
+};
+
+static int
+execute_insn(CPU_Stage *stage, const APEX_Flags *flags)
+{
+    return exec_handlers[stage->opcode](stage, flags);
+}
+
+#endif
+
+int
+APEX_isa_execute(CPU_Stage *stage, APEX_Flags *flags)
+{
+    int taken = execute_insn(stage, flags);
+
+    if (stage->flags & INSN_SETS_FLAGS)
+    {
+        flags->Z = (stage->result_buffer == 0) ? 1 : 0;
+        flags->N = (stage->result_buffer < 0) ? 1 : 0;
+        flags->P = (stage->result_buffer > 0) ? 1 : 0;
+    }
+
+    if (stage->flags & INSN_IS_BRANCH)
+    {
+        stage->memory_address = wrap_add(stage->pc, stage->imm);
+    }
+
+    return taken;
+}
@@ -0,0 +1,26 @@
+/*
+ * apex_isa.h
+ * Contains APEX instruction semantics shared by the pipeline models
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_ISA_H_
+#define _APEX_ISA_H_
+
+#include "apex_cpu.h"
+
+/*
+ * Computes the result, memory address or branch target of the instruction in
+ * the given latch and updates the flags if the instruction sets them.
+ * Returns TRUE if the instruction transfers control to
+ * stage->memory_address.
+ *
+ * The default engine dispatches through a table with one handler per
+ * opcode. Building with -DAPEX_EXEC_SWITCH selects the reference engine,
+ * a single switch over the opcode.
+ */
+int APEX_isa_execute(CPU_Stage *stage, APEX_Flags *flags);
+
+#endif
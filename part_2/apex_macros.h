@@ -12,12 +12,30 @@
 #define FALSE 0x0
 #define TRUE 0x1
 
+/* Pipeline stages, in program order */
+enum
+{
+  Fetch,
+  DRF,
+  EX,
+  MEM,
+  WB,
+  NUM_STAGES
+};
+
 /* Integers */
 #define DATA_MEMORY_SIZE 4096
 
 /* Size of integer register file */
 #define REG_FILE_SIZE 16
 
+/* Widest superscalar configuration: instructions fetched, issued and
+ * retired per cycle */
+#define APEX_MAX_WIDTH 4
+
+/* Scoreboard slot of the condition code flags, tracked like a register */
+#define CC_FLAGS_REG REG_FILE_SIZE
+
 /* Numeric OPCODE identifiers for instructions */
 #define OPCODE_ADD 0x0
 #define OPCODE_SUB 0x1
@@ -46,10 +64,33 @@
 #define OPCODE_JUMP 0x18
 #define OPCODE_JALR 0x19
 
-/* Set this flag to 1 to enable debug messages */
+/* Number of distinct opcodes, used to size opcode-indexed tables */
+#define NUM_OPCODES 0x1a
+
+/* Instruction class bits, computed once per instruction when the input file
+ * is parsed, so the pipeline stages never have to look at the opcode string */
+#define INSN_READS_RS1 0x001  /* rs1 is a source operand */
+#define INSN_READS_RS2 0x002  /* rs2 is a source operand */
+#define INSN_WRITES_RD 0x004  /* Result is written to rd */
+#define INSN_WRITES_RS1 0x008 /* rs1 is post-incremented (LOADP) */
+#define INSN_WRITES_RS2 0x010 /* rs2 is post-incremented (STOREP) */
+#define INSN_SETS_FLAGS 0x020 /* Updates Z, N and P flags */
+#define INSN_IS_BRANCH 0x040  /* Conditional branch on the flags */
+#define INSN_IS_JUMP 0x080    /* Unconditional control transfer */
+#define INSN_IS_LOAD 0x100
+#define INSN_IS_STORE 0x200
+#define INSN_IS_HALT 0x400
+
+/* Set this flag to 1 to enable debug messages. Builds may override it,
+ * apex_sim_fast is built with -DENABLE_DEBUG_MESSAGES=0 so that no tracing
+ * code is left in the cycle loop */
+#ifndef ENABLE_DEBUG_MESSAGES
 #define ENABLE_DEBUG_MESSAGES 1
+#endif
 
 /* Set this flag to 1 to enable cycle single-step mode */
+#ifndef ENABLE_SINGLE_STEP
 #define ENABLE_SINGLE_STEP 1
+#endif
 
 #endif
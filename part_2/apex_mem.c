@@ -0,0 +1,396 @@
+/*
+ * apex_mem.c
+ * Contains the sparse paged data memory behind the inline data memory array
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "apex_macros.h"
+#include "apex_mem.h"
+
+#define MEM_PAGE_BYTES (MEM_PAGE_WORDS * sizeof(int32_t))
+#define MEM_CHUNK_BYTES (MEM_CHUNK_PAGES * MEM_PAGE_BYTES)
+
+void
+APEX_mem_init(APEX_Memory *mem, int hugepages)
+{
+    memset(mem, 0, sizeof(*mem));
+    mem->hugepages = hugepages;
+}
+
+void
+APEX_mem_free(APEX_Memory *mem)
+{
+    if (mem->dir)
+    {
+        for (int d = 0; d < MEM_DIR_SIZE; ++d)
+        {
+            if (!mem->dir[d])
+            {
+                continue;
+            }
+
+            /* Huge page backed pages are freed with their chunk */
+            for (int t = 0; !mem->hugepages && t < MEM_TABLE_SIZE; ++t)
+            {
+                free(mem->dir[d][t]);
+            }
+            free(mem->dir[d]);
+        }
+        free(mem->dir);
+    }
+
+    for (int i = 0; i < mem->num_chunks; ++i)
+    {
+        free(mem->chunks[i]);
+    }
+    free(mem->chunks);
+    memset(mem, 0, sizeof(*mem));
+}
+
+/*
+ * Hands out a zeroed page from the current huge page chunk, starting a new
+ * chunk when it is used up
+ */
+static int32_t *
+alloc_huge_backed_page(APEX_Memory *mem)
+{
+    if (!mem->num_chunks || mem->chunk_used == MEM_CHUNK_PAGES)
+    {
+        char **chunks = realloc(mem->chunks, (mem->num_chunks + 1) * sizeof(*chunks));
+        char *chunk;
+
+        if (!chunks)
+        {
+            return NULL;
+        }
+        mem->chunks = chunks;
+
+        chunk = aligned_alloc(MEM_CHUNK_BYTES, MEM_CHUNK_BYTES);
+        if (!chunk)
+        {
+            return NULL;
+        }
+
+#ifdef MADV_HUGEPAGE
+        madvise(chunk, MEM_CHUNK_BYTES, MADV_HUGEPAGE);
+#endif
+        memset(chunk, 0, MEM_CHUNK_BYTES);
+        mem->chunks[mem->num_chunks++] = chunk;
+        mem->chunk_used = 0;
+    }
+
+    return (int32_t *)(mem->chunks[mem->num_chunks - 1] + MEM_PAGE_BYTES * mem->chunk_used++);
+}
+
+int32_t *
+APEX_mem_page(APEX_Memory *mem, uint32_t page, int allocate)
+{
+    uint32_t d = page >> MEM_TABLE_SHIFT;
+    uint32_t t = page & (MEM_TABLE_SIZE - 1);
+    int32_t *words;
+
+    if (d >= MEM_DIR_SIZE)
+    {
+        return NULL;
+    }
+
+    if (mem->dir && mem->dir[d] && mem->dir[d][t])
+    {
+        return mem->dir[d][t];
+    }
+
+    if (!allocate)
+    {
+        return NULL;
+    }
+
+    if (!mem->dir && !(mem->dir = calloc(MEM_DIR_SIZE, sizeof(*mem->dir))))
+    {
+        return NULL;
+    }
+
+    if (!mem->dir[d] && !(mem->dir[d] = calloc(MEM_TABLE_SIZE, sizeof(**mem->dir))))
+    {
+        return NULL;
+    }
+
+    words = mem->hugepages ? alloc_huge_backed_page(mem) : calloc(MEM_PAGE_WORDS, sizeof(*words));
+    if (words)
+    {
+        mem->dir[d][t] = words;
+        mem->pages++;
+    }
+    return words;
+}
+
+int
+APEX_mem_read(APEX_Memory *mem, int address)
+{
+    int32_t *words;
+
+    if (address < 0)
+    {
+        mem->faults++;
+        return 0;
+    }
+
+    words = APEX_mem_page(mem, (uint32_t)address >> MEM_PAGE_SHIFT, FALSE);
+    return words ? words[address & (MEM_PAGE_WORDS - 1)] : 0;
+}
+
+void
+APEX_mem_write(APEX_Memory *mem, int address, int value)
+{
+    int32_t *words;
+
+    if (address < 0)
+    {
+        mem->faults++;
+        return;
+    }
+
+    words = APEX_mem_page(mem, (uint32_t)address >> MEM_PAGE_SHIFT, TRUE);
+    if (!words)
+    {
+        mem->faults++;
+        return;
+    }
+    words[address & (MEM_PAGE_WORDS - 1)] = value;
+}
+
+void
+APEX_mem_for_each_page(const APEX_Memory *mem,
+                       void (*fn)(uint32_t page, const int32_t *words, void *arg),
+                       void *arg)
+{
+    if (!mem->dir)
+    {
+        return;
+    }
+
+    for (uint32_t d = 0; d < MEM_DIR_SIZE; ++d)
+    {
+        for (uint32_t t = 0; mem->dir[d] && t < MEM_TABLE_SIZE; ++t)
+        {
+            if (mem->dir[d][t])
+            {
+                fn((d << MEM_TABLE_SHIFT) | t, mem->dir[d][t], arg);
+            }
+        }
+    }
+}
+
+APEX_Shared_Memory *
+APEX_shared_create(int banks, int hugepages)
+{
+    APEX_Shared_Memory *shared;
+
+    if (banks < 1)
+    {
+        return NULL;
+    }
+
+    shared = calloc(1, sizeof(*shared));
+    if (!shared)
+    {
+        return NULL;
+    }
+
+    /* Cycles count from 1, so no bank starts out claimed */
+    shared->bank_cycle = calloc(banks, sizeof(*shared->bank_cycle));
+    if (!shared->bank_cycle)
+    {
+        free(shared);
+        return NULL;
+    }
+
+    shared->banks = banks;
+    APEX_mem_init(&shared->memory, hugepages);
+    return shared;
+}
+
+void
+APEX_shared_free(APEX_Shared_Memory *shared)
+{
+    if (!shared)
+    {
+        return;
+    }
+
+    APEX_mem_free(&shared->memory);
+    free(shared->bank_cycle);
+    free(shared);
+}
+
+void
+APEX_mailbox_init(APEX_Mailbox *box)
+{
+    memset(box, 0, sizeof(*box));
+}
+
+void
+APEX_mailbox_free(APEX_Mailbox *box)
+{
+    free(box->entries);
+    free(box->index);
+    memset(box, 0, sizeof(*box));
+}
+
+void
+APEX_mailbox_clear(APEX_Mailbox *box)
+{
+    if (box->stores)
+    {
+        memset(box->index, 0, box->index_size * sizeof(*box->index));
+    }
+    box->count = 0;
+    box->stores = 0;
+}
+
+static APEX_Mailbox_Entry *
+append_entry(APEX_Mailbox *box)
+{
+    if (box->count == box->capacity)
+    {
+        int capacity = box->capacity ? box->capacity * 2 : 256;
+        APEX_Mailbox_Entry *entries = realloc(box->entries, capacity * sizeof(*entries));
+
+        if (!entries)
+        {
+            return NULL;
+        }
+        box->entries = entries;
+        box->capacity = capacity;
+    }
+    return &box->entries[box->count++];
+}
+
+/* Slot of 'address' in the store index: the one holding it or the empty one
+ * it would go to */
+static int *
+index_slot(const APEX_Mailbox *box, int address)
+{
+    uint32_t mask = box->index_size - 1;
+    uint32_t i = ((uint32_t)address * 0x9e3779b1u) & mask;
+
+    while (box->index[i] && box->entries[box->index[i] - 1].address != address)
+    {
+        i = (i + 1) & mask;
+    }
+    return &box->index[i];
+}
+
+/* Makes room for one more store, rebuilding the index from the log */
+static int
+grow_index(APEX_Mailbox *box)
+{
+    int size = box->index_size ? box->index_size * 2 : 256;
+    int *index = calloc(size, sizeof(*index));
+
+    if (!index)
+    {
+        return -1;
+    }
+
+    free(box->index);
+    box->index = index;
+    box->index_size = size;
+    for (int i = 0; i < box->count; ++i)
+    {
+        if (box->entries[i].is_store && box->entries[i].address >= 0)
+        {
+            *index_slot(box, box->entries[i].address) = i + 1;
+        }
+    }
+    return 0;
+}
+
+int
+APEX_mailbox_claim(APEX_Mailbox *box, const APEX_Shared_Memory *shared, int address,
+                   int cycle)
+{
+    APEX_Mailbox_Entry *entry;
+
+    if (box->count)
+    {
+        const APEX_Mailbox_Entry *last = &box->entries[box->count - 1];
+
+        if (last->cycle == cycle
+            && (unsigned)last->address % shared->banks == (unsigned)address % shared->banks)
+        {
+            return FALSE;
+        }
+    }
+
+    entry = append_entry(box);
+    if (entry)
+    {
+        entry->cycle = cycle;
+        entry->address = address;
+        entry->value = 0;
+        entry->is_store = FALSE;
+    }
+    return TRUE;
+}
+
+int
+APEX_mailbox_read(APEX_Mailbox *box, APEX_Shared_Memory *shared, int address)
+{
+    if (address < 0)
+    {
+        box->faults++;
+        return 0;
+    }
+
+    if (box->stores)
+    {
+        int entry = *index_slot(box, address);
+
+        if (entry)
+        {
+            return box->entries[entry - 1].value;
+        }
+    }
+
+    /* Nobody writes the shared memory until the quantum barrier */
+    return APEX_shared_read(shared, address);
+}
+
+void
+APEX_mailbox_write(APEX_Mailbox *box, int address, int value, int cycle)
+{
+    APEX_Mailbox_Entry *entry = box->count ? &box->entries[box->count - 1] : NULL;
+
+    /* The access logged by the claim of this store, else a new one */
+    if (!entry || entry->is_store || entry->cycle != cycle || entry->address != address)
+    {
+        entry = append_entry(box);
+        if (!entry)
+        {
+            return;
+        }
+        entry->cycle = cycle;
+        entry->address = address;
+    }
+    entry->value = value;
+    entry->is_store = TRUE;
+
+    /* Negative addresses fault when the store is drained */
+    if (address < 0)
+    {
+        return;
+    }
+
+    if (2 * (box->stores + 1) > box->index_size && grow_index(box))
+    {
+        return;
+    }
+    *index_slot(box, address) = entry - box->entries + 1;
+    box->stores++;
+}
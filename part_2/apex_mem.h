@@ -0,0 +1,150 @@
+/*
+ * apex_mem.h
+ * Contains the sparse paged data memory behind the inline data memory array
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_MEM_H_
+#define _APEX_MEM_H_
+
+#include <stdint.h>
+
+#include "apex_macros.h"
+
+/* Data memory is word addressed. Addresses below DATA_MEMORY_SIZE live in the
+ * inline array of APEX_CPU, the rest of the non-negative address space in
+ * 4 KiB pages allocated on the first write, found through a two level table:
+ * dir[address >> 20][(address >> 10) & 1023][address & 1023]. */
+#define MEM_PAGE_SHIFT 10
+#define MEM_PAGE_WORDS (1 << MEM_PAGE_SHIFT)
+#define MEM_TABLE_SHIFT 10
+#define MEM_TABLE_SIZE (1 << MEM_TABLE_SHIFT)
+#define MEM_DIR_SIZE (1 << (31 - MEM_PAGE_SHIFT - MEM_TABLE_SHIFT))
+
+/* Pages carved out of one huge page backed chunk */
+#define MEM_CHUNK_PAGES 512
+
+typedef struct APEX_Memory
+{
+    int32_t ***dir;  /* Allocated on the first write */
+    int hugepages;   /* Back pages with 2 MiB huge page chunks */
+    char **chunks;   /* Huge page chunks, the last one is being carved */
+    int num_chunks;
+    int chunk_used;  /* Pages handed out from the last chunk */
+    uint64_t pages;  /* Pages allocated */
+    uint64_t faults; /* Accesses to negative addresses, or failed allocations */
+} APEX_Memory;
+
+void APEX_mem_init(APEX_Memory *mem, int hugepages);
+void APEX_mem_free(APEX_Memory *mem);
+
+/* Slow paths of APEX_cpu_mem_read() and APEX_cpu_mem_write(). Reading a page
+ * that was never written returns 0 without allocating it. A fault reads as 0
+ * and drops the write. */
+int APEX_mem_read(APEX_Memory *mem, int address);
+void APEX_mem_write(APEX_Memory *mem, int address, int value);
+
+/* Returns the page holding words [page << MEM_PAGE_SHIFT, +MEM_PAGE_WORDS),
+ * allocating it if 'allocate' is set, or NULL */
+int32_t *APEX_mem_page(APEX_Memory *mem, uint32_t page, int allocate);
+
+/* Calls 'fn' for each allocated page in address order */
+void APEX_mem_for_each_page(const APEX_Memory *mem,
+                            void (*fn)(uint32_t page, const int32_t *words, void *arg),
+                            void *arg);
+
+/* Data memory shared by the cores of an APEX_System, laid out like the one of
+ * a single cpu. Words are interleaved over 'banks' banks, and each bank serves
+ * one access per cycle. */
+typedef struct APEX_Shared_Memory
+{
+    APEX_Memory memory; /* Addresses above the inline array */
+    int banks;
+    int *bank_cycle;    /* Last cycle each bank was claimed in or is busy until */
+    int32_t data_memory[DATA_MEMORY_SIZE];
+} APEX_Shared_Memory;
+
+/* Returns a zeroed shared memory of 'banks' banks, or NULL */
+APEX_Shared_Memory *APEX_shared_create(int banks, int hugepages);
+void APEX_shared_free(APEX_Shared_Memory *shared);
+
+static inline int
+APEX_shared_read(APEX_Shared_Memory *shared, int address)
+{
+    if ((unsigned)address < DATA_MEMORY_SIZE)
+    {
+        return shared->data_memory[address];
+    }
+    return APEX_mem_read(&shared->memory, address);
+}
+
+static inline void
+APEX_shared_write(APEX_Shared_Memory *shared, int address, int value)
+{
+    if ((unsigned)address < DATA_MEMORY_SIZE)
+    {
+        shared->data_memory[address] = value;
+        return;
+    }
+    APEX_mem_write(&shared->memory, address, value);
+}
+
+/* Claims the bank of 'address' for 'cycle'. Returns FALSE if an earlier
+ * access of the same cycle already holds it. */
+static inline int
+APEX_shared_claim(APEX_Shared_Memory *shared, int address, int cycle)
+{
+    int *bank = &shared->bank_cycle[(unsigned)address % shared->banks];
+
+    if (*bank == cycle)
+    {
+        return FALSE;
+    }
+    *bank = cycle;
+    return TRUE;
+}
+
+/* One data access of a core in a quantum, see APEX_Mailbox */
+typedef struct APEX_Mailbox_Entry
+{
+    int cycle;
+    int address;
+    int value;
+    int is_store;
+} APEX_Mailbox_Entry;
+
+/* Data accesses of one core to a shared memory during a quantum of the
+ * host-parallel system. Only the thread of the core appends to it and it is
+ * drained at the quantum barrier, so it needs no lock. Stores reach the
+ * shared memory when they are drained, until then the core reads its own
+ * stores back through 'index', an open addressing table of the youngest
+ * store to each address. */
+typedef struct APEX_Mailbox
+{
+    APEX_Mailbox_Entry *entries; /* In cycle order */
+    int count;
+    int capacity;
+    int *index;     /* Entry + 1 of a store, 0 for an empty slot */
+    int index_size; /* Power of 2, at least twice 'stores' */
+    int stores;
+    uint64_t faults; /* Reads of negative addresses */
+} APEX_Mailbox;
+
+void APEX_mailbox_init(APEX_Mailbox *box);
+void APEX_mailbox_free(APEX_Mailbox *box);
+
+/* Empties the mailbox once its accesses have been applied */
+void APEX_mailbox_clear(APEX_Mailbox *box);
+
+/* Logs an access in 'cycle'. Returns FALSE if an earlier access of the same
+ * core and cycle already holds the bank, the other cores are only arbitrated
+ * against when the mailbox is drained. */
+int APEX_mailbox_claim(APEX_Mailbox *box, const APEX_Shared_Memory *shared, int address,
+                       int cycle);
+
+int APEX_mailbox_read(APEX_Mailbox *box, APEX_Shared_Memory *shared, int address);
+void APEX_mailbox_write(APEX_Mailbox *box, int address, int value, int cycle);
+
+#endif
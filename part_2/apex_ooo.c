@@ -0,0 +1,818 @@
+/*
+ * apex_ooo.c
+ * Contains the out-of-order timing model of the APEX cpu
+ *
+ * Instructions are fetched in program order, renamed into a reorder buffer
+ * and an issue queue, issued to the functional units as soon as their
+ * operands are ready and committed in program order. Results live in the
+ * reorder buffer until commit, stores write data memory at commit. The
+ * parser, instruction semantics, BTB, caches, functional unit latencies and
+ * statistics are the ones of the in-order pipeline.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_isa.h"
+#include "apex_macros.h"
+#include "apex_ooo.h"
+
+static APEX_OoO_Entry *
+rob_entry(const APEX_OoO *ooo, int64_t seq)
+{
+    return &ooo->rob[seq % ooo->rob_size];
+}
+
+static int
+rob_count(const APEX_OoO *ooo)
+{
+    return (int)(ooo->next_seq - ooo->head_seq);
+}
+
+/*
+ * Returns TRUE if the result of producer 'seq' can be read: it has committed
+ * or its entry is done
+ */
+static int
+producer_ready(const APEX_OoO *ooo, int64_t seq)
+{
+    return seq < ooo->head_seq || rob_entry(ooo, seq)->state == OOO_DONE;
+}
+
+/*
+ * Value of register 'reg' as written by producer 'seq', from the register
+ * file once it has committed
+ */
+static int
+read_operand(const APEX_CPU *cpu, int64_t seq, int reg)
+{
+    if (seq < cpu->ooo->head_seq)
+    {
+        return cpu->regs[reg];
+    }
+    return APEX_stage_result(&rob_entry(cpu->ooo, seq)->insn, reg);
+}
+
+/*
+ * Accounts the current cycle of 'stage' to 'cause'
+ */
+static void
+account_cycle(APEX_CPU *cpu, int stage, int cause)
+{
+    cpu->stats.stage_cycles[stage][cause]++;
+}
+
+/*
+ * Drops every instruction younger than 'seq' after it mispredicted and
+ * rebuilds the alias table from the instructions that remain
+ */
+static void
+squash(APEX_CPU *cpu, int64_t seq)
+{
+    APEX_OoO *ooo = cpu->ooo;
+    int kept = 0;
+
+    for (int64_t s = seq + 1; s < ooo->next_seq; ++s)
+    {
+        APEX_OoO_Entry *e = rob_entry(ooo, s);
+
+        if (e->state == OOO_EXECUTING)
+        {
+            cpu->fu[APEX_fu_class(e->insn.opcode)].in_flight--;
+        }
+        e->state = OOO_FREE;
+        ooo->squashed++;
+    }
+    ooo->next_seq = seq + 1;
+
+    for (int i = 0; i < ooo->iq_count; ++i)
+    {
+        if (ooo->iq[i] <= seq)
+        {
+            ooo->iq[kept++] = ooo->iq[i];
+        }
+    }
+    ooo->iq_count = kept;
+
+    for (int i = 0; i <= REG_FILE_SIZE; ++i)
+    {
+        ooo->rat[i] = -1;
+    }
+    for (int64_t s = ooo->head_seq; s <= seq; ++s)
+    {
+        uint32_t dst_mask = rob_entry(ooo, s)->insn.dst_mask;
+
+        while (dst_mask)
+        {
+            ooo->rat[__builtin_ctz(dst_mask)] = s;
+            dst_mask &= dst_mask - 1;
+        }
+    }
+
+    /* Fetch restarts on the correct path, a pending I-cache miss on the
+     * wrong path is dropped */
+    ooo->num_pending = 0;
+    ooo->fq_count = 0;
+    ooo->fetch_busy = 0;
+    ooo->fetch_stopped = FALSE;
+}
+
+/*
+ * Commits up to width finished instructions from the head of the reorder
+ * buffer to the register file, flags and data memory. Returns TRUE once HALT
+ * has committed.
+ */
+static int
+ooo_commit(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = cpu->ooo;
+    int committed = 0;
+    int bank_conflict = FALSE;
+    int cause;
+
+    while (committed < ooo->width && rob_count(ooo))
+    {
+        APEX_OoO_Entry *e = rob_entry(ooo, ooo->head_seq);
+        CPU_Stage *insn = &e->insn;
+        uint32_t dst_mask = insn->dst_mask;
+
+        if (e->state != OOO_DONE)
+        {
+            break;
+        }
+
+        /* A store whose shared memory bank is taken commits next cycle */
+        if ((insn->flags & INSN_IS_STORE) && !APEX_cpu_mem_claim(cpu, insn->memory_address))
+        {
+            bank_conflict = TRUE;
+            break;
+        }
+
+        if (insn->flags & INSN_WRITES_RD)
+        {
+            cpu->regs[insn->rd] = insn->result_buffer;
+        }
+
+        if (insn->flags & INSN_WRITES_RS1)
+        {
+            cpu->regs[insn->rs1] = insn->rs1_value;
+        }
+
+        if (insn->flags & INSN_WRITES_RS2)
+        {
+            cpu->regs[insn->rs2] = insn->rs2_value;
+        }
+
+        if (insn->flags & INSN_SETS_FLAGS)
+        {
+            cpu->cc_flags = e->flags;
+        }
+
+        /* Stores leave a write buffer at commit, they do not hold it up */
+        if (insn->flags & INSN_IS_STORE)
+        {
+            APEX_cpu_mem_write(cpu, insn->memory_address, insn->rs1_value);
+
+            if (cpu->dcache.lines)
+            {
+                APEX_cache_access(&cpu->dcache, insn->memory_address, TRUE);
+            }
+
+            if (cpu->profile)
+            {
+                cpu->profile[get_code_memory_index_from_pc(insn->pc)].mem_accesses++;
+            }
+        }
+
+        /* The BTB learns from the committed path only */
+        if (insn->flags & (INSN_IS_BRANCH | INSN_IS_JUMP))
+        {
+            cpu->btb.resolved++;
+            APEX_btb_update(&cpu->btb, insn->pc, e->taken, insn->memory_address);
+
+            if (e->mispredicted)
+            {
+                cpu->btb.mispredicts++;
+            }
+        }
+
+        while (dst_mask)
+        {
+            int reg = __builtin_ctz(dst_mask);
+
+            if (ooo->rat[reg] == e->seq)
+            {
+                ooo->rat[reg] = -1;
+            }
+            dst_mask &= dst_mask - 1;
+        }
+
+        cpu->insn_completed++;
+        cpu->stats.opcode_retired[insn->opcode]++;
+
+        if (cpu->profile)
+        {
+            cpu->profile[get_code_memory_index_from_pc(insn->pc)].executed++;
+        }
+
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            APEX_cpu_print_stage("Commit", insn);
+        }
+
+        e->state = OOO_FREE;
+        ooo->head_seq++;
+        committed++;
+
+        if (insn->flags & INSN_IS_HALT)
+        {
+            account_cycle(cpu, WB, CYCLE_USEFUL);
+            return TRUE;
+        }
+    }
+
+    if (committed)
+    {
+        account_cycle(cpu, WB, CYCLE_USEFUL);
+        return FALSE;
+    }
+
+    /* The CPI stack is taken here, a cycle without a commit is accounted to
+     * whatever holds up the oldest instruction */
+    if (!rob_count(ooo))
+    {
+        cause = ooo->refill_cause;
+    }
+    else
+    {
+        APEX_OoO_Entry *head = rob_entry(ooo, ooo->head_seq);
+        int latency = cpu->fu[APEX_fu_class(head->insn.opcode)].config.latency;
+
+        if (head->mem_stall || bank_conflict)
+        {
+            cause = CYCLE_MEMORY_STALL;
+        }
+        else if (latency > 1)
+        {
+            cause = CYCLE_STRUCTURAL_STALL;
+        }
+        else
+        {
+            /* Still on its way through rename and issue, held up by the
+             * bubble it was fetched after */
+            cause = head->insn.cause;
+        }
+
+        if (cpu->profile)
+        {
+            cpu->profile[get_code_memory_index_from_pc(head->insn.pc)].stall_cycles++;
+        }
+    }
+
+    if (cause == CYCLE_FLUSH)
+    {
+        cpu->btb.flush_cycles++;
+
+        if (cpu->profile)
+        {
+            cpu->profile[get_code_memory_index_from_pc(ooo->flush_pc)].flush_cycles++;
+        }
+    }
+
+    account_cycle(cpu, WB, cause);
+    return FALSE;
+}
+
+/*
+ * Counts down the instructions in the functional units. A finished branch or
+ * jump that was mispredicted squashes the younger instructions and redirects
+ * fetch.
+ */
+static void
+ooo_complete(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = cpu->ooo;
+    int completed = 0;
+    int mem_stall = FALSE;
+    int executing = FALSE;
+
+    for (int i = 0; i < NUM_FU_CLASSES; ++i)
+    {
+        cpu->fu[i].occupancy += cpu->fu[i].in_flight;
+    }
+
+    /* In program order, so an older mispredict squashes a younger one */
+    for (int64_t s = ooo->head_seq; s < ooo->next_seq; ++s)
+    {
+        APEX_OoO_Entry *e = rob_entry(ooo, s);
+        int next_pc;
+
+        if (e->state != OOO_EXECUTING)
+        {
+            continue;
+        }
+
+        if (--e->busy)
+        {
+            executing = TRUE;
+            mem_stall |= e->mem_stall;
+            continue;
+        }
+
+        e->state = OOO_DONE;
+        e->mem_stall = FALSE;
+        cpu->fu[APEX_fu_class(e->insn.opcode)].in_flight--;
+        completed++;
+
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            APEX_cpu_print_stage("Complete", &e->insn);
+        }
+
+        if (!(e->insn.flags & (INSN_IS_BRANCH | INSN_IS_JUMP)))
+        {
+            continue;
+        }
+
+        next_pc = e->taken ? e->insn.memory_address : e->insn.pc + 4;
+        if (next_pc != e->insn.predicted_pc)
+        {
+            e->mispredicted = TRUE;
+            squash(cpu, s);
+            cpu->pc = next_pc;
+            ooo->flush_pc = e->insn.pc;
+            ooo->refill_cause = CYCLE_FLUSH;
+        }
+    }
+
+    if (completed)
+    {
+        account_cycle(cpu, MEM, CYCLE_USEFUL);
+    }
+    else if (executing)
+    {
+        account_cycle(cpu, MEM, mem_stall ? CYCLE_MEMORY_STALL : CYCLE_STRUCTURAL_STALL);
+    }
+    else
+    {
+        account_cycle(cpu, MEM, ooo->refill_cause);
+    }
+}
+
+/*
+ * Returns TRUE if every store older than load 'seq' has its address, and
+ * sets 'value' to the data of the youngest of them to the same address, if
+ * there is one
+ */
+static int
+load_disambiguated(const APEX_OoO *ooo, int64_t seq, int address, int *value, int *forwarded)
+{
+    *forwarded = FALSE;
+
+    for (int64_t s = seq - 1; s >= ooo->head_seq; --s)
+    {
+        const APEX_OoO_Entry *e = rob_entry(ooo, s);
+
+        if (!(e->insn.flags & INSN_IS_STORE))
+        {
+            continue;
+        }
+
+        if (e->state == OOO_WAITING)
+        {
+            return FALSE;
+        }
+
+        if (!*forwarded && e->insn.memory_address == address)
+        {
+            *value = e->insn.rs1_value;
+            *forwarded = TRUE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Sends up to width ready instructions from the issue queue to their units,
+ * oldest first. There is an ALU per unit of width and one load/store unit,
+ * multiplier and divider, each taking one operation per cycle when pipelined
+ * and one at a time when not. Operands are read and the instruction is
+ * executed on issue, its result becomes visible when its unit is done.
+ */
+static void
+ooo_issue(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = cpu->ooo;
+    int accepted[NUM_FU_CLASSES] = {0};
+    uint32_t stalled_units = 0;
+    int issued = 0;
+    int kept = 0;
+    int cause = CYCLE_USEFUL;
+
+    for (int i = 0; i < ooo->iq_count; ++i)
+    {
+        APEX_OoO_Entry *e = rob_entry(ooo, ooo->iq[i]);
+        CPU_Stage *insn = &e->insn;
+        int fu_class = APEX_fu_class(insn->opcode);
+        APEX_FU *fu = &cpu->fu[fu_class];
+        int limit = fu_class == FU_ALU ? ooo->width : 1;
+        APEX_Flags flags;
+        int blocked = CYCLE_USEFUL;
+
+        if (issued == ooo->width)
+        {
+            blocked = CYCLE_STRUCTURAL_STALL;
+        }
+        else if (!producer_ready(ooo, e->src[0]) || !producer_ready(ooo, e->src[1]))
+        {
+            blocked = CYCLE_DATA_STALL;
+        }
+        else if (!producer_ready(ooo, e->src[2]))
+        {
+            blocked = CYCLE_FLAG_STALL;
+        }
+        else if (accepted[fu_class] == limit || (!fu->config.pipelined && fu->in_flight))
+        {
+            blocked = CYCLE_STRUCTURAL_STALL;
+            if (!(stalled_units & (1u << fu_class)))
+            {
+                stalled_units |= 1u << fu_class;
+                fu->stall_cycles++;
+            }
+        }
+
+        if (blocked == CYCLE_USEFUL)
+        {
+            if (insn->flags & INSN_READS_RS1)
+            {
+                insn->rs1_value = read_operand(cpu, e->src[0], insn->rs1);
+            }
+
+            if (insn->flags & INSN_READS_RS2)
+            {
+                insn->rs2_value = read_operand(cpu, e->src[1], insn->rs2);
+            }
+
+            flags = e->src[2] < ooo->head_seq ? cpu->cc_flags : rob_entry(ooo, e->src[2])->flags;
+            e->taken = APEX_isa_execute(insn, &flags);
+            e->busy = fu->config.latency;
+
+            if (insn->flags & INSN_IS_LOAD)
+            {
+                int forwarded;
+
+                /* Data memory is read once the older stores are known, the
+                 * data of a matching store is forwarded instead */
+                if (!load_disambiguated(ooo, e->seq, insn->memory_address,
+                                        &insn->result_buffer, &forwarded))
+                {
+                    blocked = CYCLE_DATA_STALL;
+                }
+                else if (forwarded)
+                {
+                    ooo->load_forwards++;
+                    e->busy++;
+                }
+                else if (!APEX_cpu_mem_claim(cpu, insn->memory_address))
+                {
+                    /* Lost the shared memory bank, the commit stall behind
+                     * it is accounted to memory */
+                    blocked = CYCLE_MEMORY_STALL;
+                    e->mem_stall = TRUE;
+                }
+                else
+                {
+                    int latency = 1;
+
+                    insn->result_buffer = APEX_cpu_mem_read(cpu, insn->memory_address);
+                    if (cpu->dcache.lines)
+                    {
+                        latency = APEX_cache_access(&cpu->dcache, insn->memory_address, FALSE);
+                    }
+                    e->busy += latency;
+                    e->mem_stall = latency > 1;
+
+                    if (cpu->profile)
+                    {
+                        cpu->profile[get_code_memory_index_from_pc(insn->pc)].mem_accesses++;
+                    }
+                }
+            }
+        }
+
+        if (blocked != CYCLE_USEFUL)
+        {
+            /* The oldest instruction that can not go names the stall */
+            if (cause == CYCLE_USEFUL)
+            {
+                cause = blocked;
+            }
+            ooo->iq[kept++] = ooo->iq[i];
+            continue;
+        }
+
+        if (insn->flags & INSN_SETS_FLAGS)
+        {
+            e->flags = flags;
+        }
+
+        e->state = OOO_EXECUTING;
+        fu->in_flight++;
+        fu->operations++;
+        accepted[fu_class]++;
+        issued++;
+
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            APEX_cpu_print_stage("Issue", insn);
+        }
+    }
+    ooo->iq_count = kept;
+
+    if (issued)
+    {
+        cpu->stats.issue_groups[issued - 1]++;
+        account_cycle(cpu, EX, CYCLE_USEFUL);
+    }
+    else
+    {
+        account_cycle(cpu, EX, ooo->iq_count ? cause : ooo->refill_cause);
+    }
+}
+
+/*
+ * Renames up to width instructions from the fetch queue into the reorder
+ * buffer and the issue queue
+ */
+static void
+ooo_dispatch(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = cpu->ooo;
+    int dispatched = 0;
+    int cause;
+
+    while (dispatched < ooo->width && dispatched < ooo->fq_count
+           && rob_count(ooo) < ooo->rob_size && ooo->iq_count < ooo->iq_size)
+    {
+        APEX_OoO_Entry *e = rob_entry(ooo, ooo->next_seq);
+        uint32_t dst_mask;
+
+        memset(e, 0, sizeof(*e));
+        e->insn = ooo->fetch_queue[dispatched];
+        e->seq = ooo->next_seq++;
+        e->state = OOO_WAITING;
+
+        e->src[0] = (e->insn.flags & INSN_READS_RS1) ? ooo->rat[e->insn.rs1] : -1;
+        e->src[1] = (e->insn.flags & INSN_READS_RS2) ? ooo->rat[e->insn.rs2] : -1;
+        e->src[2] = (e->insn.src_mask & (1u << CC_FLAGS_REG)) ? ooo->rat[CC_FLAGS_REG] : -1;
+
+        for (dst_mask = e->insn.dst_mask; dst_mask; dst_mask &= dst_mask - 1)
+        {
+            ooo->rat[__builtin_ctz(dst_mask)] = e->seq;
+        }
+
+        ooo->iq[ooo->iq_count++] = e->seq;
+        dispatched++;
+
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            APEX_cpu_print_stage("Dispatch", &e->insn);
+        }
+    }
+
+    ooo->fq_count -= dispatched;
+    memmove(ooo->fetch_queue, &ooo->fetch_queue[dispatched],
+            ooo->fq_count * sizeof(ooo->fetch_queue[0]));
+
+    if (rob_count(ooo) == ooo->rob_size)
+    {
+        ooo->rob_full_cycles++;
+    }
+    if (ooo->iq_count == ooo->iq_size)
+    {
+        ooo->iq_full_cycles++;
+    }
+
+    if (dispatched)
+    {
+        cause = CYCLE_USEFUL;
+    }
+    else if (ooo->fq_count)
+    {
+        cause = CYCLE_STRUCTURAL_STALL;
+    }
+    else
+    {
+        cause = ooo->refill_cause;
+    }
+    account_cycle(cpu, DRF, cause);
+}
+
+/*
+ * Fetches a group of up to width sequential instructions, ending after a
+ * branch predicted taken and at HALT, and queues it for rename once its
+ * I-cache accesses are done
+ */
+static void
+ooo_fetch(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = cpu->ooo;
+    int latency = 1;
+
+    if (!ooo->num_pending)
+    {
+        if (ooo->fetch_stopped)
+        {
+            account_cycle(cpu, Fetch, ooo->refill_cause);
+            return;
+        }
+
+        while (ooo->num_pending < ooo->width)
+        {
+            int index = get_code_memory_index_from_pc(cpu->pc);
+            const APEX_Instruction *current_ins;
+            CPU_Stage *slot = &ooo->pending[ooo->num_pending];
+
+            if (index < 0 || index >= cpu->code_memory_size)
+            {
+                break;
+            }
+
+            current_ins = &cpu->code_memory[index];
+            memset(slot, 0, sizeof(*slot));
+            slot->pc = cpu->pc;
+            slot->opcode = current_ins->opcode;
+            slot->flags = current_ins->flags;
+            slot->rd = current_ins->rd;
+            slot->rs1 = current_ins->rs1;
+            slot->rs2 = current_ins->rs2;
+            slot->imm = current_ins->imm;
+            slot->src_mask = current_ins->src_mask;
+            slot->dst_mask = current_ins->dst_mask;
+
+            cpu->pc = APEX_btb_predict(&cpu->btb, cpu->pc);
+            slot->predicted_pc = cpu->pc;
+            ooo->num_pending++;
+
+            if (cpu->icache.lines)
+            {
+                int slot_latency = APEX_cache_access(&cpu->icache, slot->pc / 4, FALSE);
+
+                if (slot_latency > latency)
+                {
+                    latency = slot_latency;
+                }
+            }
+
+            if ((slot->flags & INSN_IS_HALT) || slot->predicted_pc != slot->pc + 4)
+            {
+                break;
+            }
+        }
+
+        if (!ooo->num_pending)
+        {
+            ooo->fetch_stopped = TRUE;
+            ooo->refill_cause = CYCLE_EMPTY;
+            account_cycle(cpu, Fetch, CYCLE_EMPTY);
+            return;
+        }
+        ooo->fetch_busy = latency - 1;
+    }
+
+    if (ooo->fetch_busy)
+    {
+        ooo->fetch_busy--;
+        ooo->refill_cause = CYCLE_FETCH_STALL;
+        account_cycle(cpu, Fetch, CYCLE_FETCH_STALL);
+
+        if (cpu->profile)
+        {
+            cpu->profile[get_code_memory_index_from_pc(ooo->pending[0].pc)].fetch_cycles++;
+        }
+        return;
+    }
+
+    if (ooo->fq_count + ooo->num_pending > OOO_FETCH_QUEUE_DEPTH * ooo->width)
+    {
+        account_cycle(cpu, Fetch, CYCLE_STRUCTURAL_STALL);
+        return;
+    }
+
+    /* Each instruction remembers the bubble it follows, a stall of the
+     * oldest instruction still on its way to issue is accounted to it */
+    for (int i = 0; i < ooo->num_pending; ++i)
+    {
+        CPU_Stage *slot = &ooo->fetch_queue[ooo->fq_count++];
+
+        *slot = ooo->pending[i];
+        slot->cause = ooo->refill_cause;
+
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            APEX_cpu_print_stage("Fetch", slot);
+        }
+
+        if (slot->flags & INSN_IS_HALT)
+        {
+            ooo->fetch_stopped = TRUE;
+        }
+    }
+    ooo->num_pending = 0;
+    ooo->refill_cause = ooo->fetch_stopped ? CYCLE_HALT_DRAIN : CYCLE_EMPTY;
+    account_cycle(cpu, Fetch, CYCLE_USEFUL);
+}
+
+APEX_OoO *
+APEX_ooo_create(const APEX_Config *config)
+{
+    APEX_OoO *ooo;
+
+    if (config->rob_size < 1 || config->rob_size > OOO_MAX_ROB_SIZE
+        || config->iq_size < 1 || config->iq_size > config->rob_size)
+    {
+        return NULL;
+    }
+
+    ooo = calloc(1, sizeof(*ooo));
+    if (!ooo)
+    {
+        return NULL;
+    }
+
+    ooo->rob_size = config->rob_size;
+    ooo->iq_size = config->iq_size;
+    ooo->width = config->width;
+    ooo->rob = calloc(ooo->rob_size, sizeof(*ooo->rob));
+    ooo->iq = calloc(ooo->iq_size, sizeof(*ooo->iq));
+    if (!ooo->rob || !ooo->iq)
+    {
+        APEX_ooo_free(ooo);
+        return NULL;
+    }
+
+    for (int i = 0; i <= REG_FILE_SIZE; ++i)
+    {
+        ooo->rat[i] = -1;
+    }
+    ooo->refill_cause = CYCLE_EMPTY;
+    return ooo;
+}
+
+void
+APEX_ooo_free(APEX_OoO *ooo)
+{
+    if (ooo)
+    {
+        free(ooo->rob);
+        free(ooo->iq);
+        free(ooo);
+    }
+}
+
+/*
+ * Stages run from commit back to fetch, so an instruction moves on by at most
+ * one step per cycle and a result is read by its consumers from the cycle
+ * after its unit is done
+ */
+int
+APEX_ooo_cycle(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = cpu->ooo;
+
+    ooo->rob_occupancy += rob_count(ooo);
+    ooo->iq_occupancy += ooo->iq_count;
+
+    if (ooo_commit(cpu))
+    {
+        return TRUE;
+    }
+
+    ooo_complete(cpu);
+    ooo_issue(cpu);
+    ooo_dispatch(cpu);
+    ooo_fetch(cpu);
+    return FALSE;
+}
+
+void
+APEX_ooo_print_stats(const APEX_OoO *ooo, int cycles)
+{
+    if (cycles < 1)
+    {
+        return;
+    }
+
+    printf("APEX_CPU: OoO width %d, ROB %d entries average %.1f full %llu cycles, "
+           "IQ %d entries average %.1f full %llu cycles\n",
+           ooo->width, ooo->rob_size, (double)ooo->rob_occupancy / cycles,
+           (unsigned long long)ooo->rob_full_cycles, ooo->iq_size,
+           (double)ooo->iq_occupancy / cycles, (unsigned long long)ooo->iq_full_cycles);
+    printf("APEX_CPU: OoO squashed instructions = %llu store-to-load forwards = %llu\n",
+           (unsigned long long)ooo->squashed, (unsigned long long)ooo->load_forwards);
+}
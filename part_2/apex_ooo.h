@@ -0,0 +1,102 @@
+/*
+ * apex_ooo.h
+ * Contains the out-of-order timing model of the APEX cpu
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_OOO_H_
+#define _APEX_OOO_H_
+
+#include <stdint.h>
+
+#include "apex_cpu.h"
+
+/* Largest reorder buffer and issue queue that can be configured */
+#define OOO_MAX_ROB_SIZE 1024
+
+/* Instructions the fetch queue holds per unit of width */
+#define OOO_FETCH_QUEUE_DEPTH 2
+
+/* State of a reorder buffer entry */
+enum
+{
+    OOO_FREE,      /* Not in the reorder buffer */
+    OOO_WAITING,   /* In the issue queue */
+    OOO_EXECUTING, /* In its functional unit */
+    OOO_DONE       /* Result ready, waiting to commit */
+};
+
+/* Reorder buffer entry. Results stay here until commit, so the entry is also
+ * the renamed destination register of the instruction. Producers are named
+ * by their sequence number, which also selects their slot; a producer that is
+ * no longer in the reorder buffer has committed to the register file. */
+typedef struct APEX_OoO_Entry
+{
+    CPU_Stage insn;   /* Instruction, operands and results */
+    APEX_Flags flags; /* Flags it sets */
+    int64_t seq;      /* Position in program order */
+    int64_t src[3];   /* Producers of rs1, rs2 and the flags, -1 if committed */
+    int busy;         /* Cycles left in its unit */
+    uint8_t state;    /* OOO_* */
+    uint8_t taken;    /* Branch or jump taken */
+    uint8_t mispredicted;
+    uint8_t mem_stall; /* Load waiting on a data cache miss */
+} APEX_OoO_Entry;
+
+typedef struct APEX_OoO
+{
+    int rob_size;
+    int iq_size;
+    int width; /* Instructions fetched, dispatched, issued and committed per cycle */
+
+    /* Reorder buffer, entry seq lives in rob[seq % rob_size] */
+    APEX_OoO_Entry *rob;
+    int64_t head_seq; /* Oldest instruction */
+    int64_t next_seq; /* Next instruction dispatched */
+
+    /* Issue queue of reorder buffer entries, oldest first */
+    int64_t *iq;
+    int iq_count;
+
+    /* Register alias table: youngest in-flight writer of each register and
+     * of the flags (CC_FLAGS_REG), or -1 */
+    int64_t rat[REG_FILE_SIZE + 1];
+
+    /* Front end: the group being fetched and the queue to rename */
+    CPU_Stage pending[APEX_MAX_WIDTH];
+    int num_pending;
+    int fetch_busy; /* Cycles left of an I-cache miss */
+    int fetch_stopped; /* HALT fetched or pc left code memory */
+    CPU_Stage fetch_queue[OOO_FETCH_QUEUE_DEPTH * APEX_MAX_WIDTH];
+    int fq_count;
+
+    /* Cause of the bubbles the front end sends down, stamped on the next
+     * fetched instructions */
+    int refill_cause;
+    int flush_pc; /* Branch of the last mispredict */
+
+    /* Statistics */
+    uint64_t rob_occupancy; /* Entries summed over the cycles */
+    uint64_t iq_occupancy;
+    uint64_t rob_full_cycles;
+    uint64_t iq_full_cycles;
+    uint64_t squashed;       /* Wrong path instructions renamed */
+    uint64_t load_forwards;  /* Loads served by an older store */
+} APEX_OoO;
+
+/* Allocates an engine with the reorder buffer, issue queue and width of
+ * 'config'. Returns NULL if a size is out of range. */
+APEX_OoO *APEX_ooo_create(const APEX_Config *config);
+
+void APEX_ooo_free(APEX_OoO *ooo);
+
+/* Simulates one clock cycle of 'cpu' on its out-of-order engine. Returns
+ * TRUE once HALT has committed. */
+int APEX_ooo_cycle(APEX_CPU *cpu);
+
+/* Prints the occupancy counters of the reorder buffer and issue queue */
+void APEX_ooo_print_stats(const APEX_OoO *ooo, int cycles);
+
+#endif
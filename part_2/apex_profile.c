@@ -0,0 +1,164 @@
+/*
+ * apex_profile.c
+ * Contains the annotated listing written by the per-instruction profiler
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_profile.h"
+
+/* Bubbles an instruction put in the pipeline */
+static uint64_t
+entry_cost(const APEX_Profile_Entry *entry)
+{
+    return entry->stall_cycles + entry->flush_cycles + entry->fetch_cycles;
+}
+
+/* Sort key of the hot spot list, kept with the index so that qsort() needs
+ * no global state */
+typedef struct Profile_Rank
+{
+    uint64_t cost;
+    uint64_t executed;
+    int index;
+} Profile_Rank;
+
+static int
+compare_rank(const void *a, const void *b)
+{
+    const Profile_Rank *x = a;
+    const Profile_Rank *y = b;
+
+    if (x->cost != y->cost)
+    {
+        return x->cost < y->cost ? 1 : -1;
+    }
+
+    if (x->executed != y->executed)
+    {
+        return x->executed < y->executed ? 1 : -1;
+    }
+
+    return x->index - y->index;
+}
+
+static void
+write_entry(FILE *out, const APEX_Profile_Entry *entry, int index, uint64_t total_cost,
+            const char *source)
+{
+    fprintf(out, "%6d %10llu %10llu %10llu %10llu %10llu %6.1f%%  %s\n", 4000 + index * 4,
+            (unsigned long long)entry->executed, (unsigned long long)entry->stall_cycles,
+            (unsigned long long)entry->flush_cycles, (unsigned long long)entry->fetch_cycles,
+            (unsigned long long)entry->mem_accesses,
+            total_cost ? 100.0 * entry_cost(entry) / total_cost : 0.0, source);
+}
+
+/*
+ * Writes the profile of 'cpu' as a listing of 'asm_file', one line of counters
+ * per instruction in program order, followed by the instructions sorted by
+ * the stall, flush and fetch cycles they caused. Returns 0 on success, -1 if the
+ * cpu was not profiled, a file can not be opened or the profile can not be
+ * written in full.
+ */
+int
+APEX_cpu_profile_write(const APEX_CPU *cpu, const char *asm_file, const char *filename)
+{
+    const char *header = "#   pc   executed      stall      flush      fetch     memory   cost  source\n";
+    char **source;
+    FILE *in;
+    FILE *out;
+    char *line = NULL;
+    size_t len = 0;
+    Profile_Rank *order;
+    int lines = 0;
+    uint64_t total_cost = 0;
+    int ret = 0;
+
+    if (!cpu->profile)
+    {
+        return -1;
+    }
+
+    in = fopen(asm_file, "r");
+    if (!in)
+    {
+        return -1;
+    }
+
+    out = fopen(filename, "w");
+    if (!out)
+    {
+        fclose(in);
+        return -1;
+    }
+
+    /* The parser reads one instruction per line */
+    source = calloc(cpu->code_memory_size, sizeof(*source));
+    order = calloc(cpu->code_memory_size, sizeof(*order));
+    while (source && lines < cpu->code_memory_size && getline(&line, &len, in) != -1)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        source[lines++] = strdup(line);
+    }
+    free(line);
+    fclose(in);
+
+    for (int i = 0; i < cpu->code_memory_size; ++i)
+    {
+        total_cost += entry_cost(&cpu->profile[i]);
+    }
+
+    fprintf(out, "# APEX profile of %s: %d cycles, %d instructions retired, %llu stall, flush and fetch cycles\n",
+            asm_file, cpu->clock, cpu->insn_completed, (unsigned long long)total_cost);
+    fprintf(out, "%s", header);
+    for (int i = 0; i < cpu->code_memory_size; ++i)
+    {
+        write_entry(out, &cpu->profile[i], i, total_cost,
+                    (source && source[i]) ? source[i] : "");
+    }
+
+    if (order)
+    {
+        for (int i = 0; i < cpu->code_memory_size; ++i)
+        {
+            order[i].cost = entry_cost(&cpu->profile[i]);
+            order[i].executed = cpu->profile[i].executed;
+            order[i].index = i;
+        }
+
+        qsort(order, cpu->code_memory_size, sizeof(*order), compare_rank);
+
+        fprintf(out, "\n# Hot spots, by stall, flush and fetch cycles caused\n%s", header);
+        for (int i = 0; i < cpu->code_memory_size && order[i].cost; ++i)
+        {
+            int index = order[i].index;
+
+            write_entry(out, &cpu->profile[index], index, total_cost,
+                        (source && source[index]) ? source[index] : "");
+        }
+    }
+
+    for (int i = 0; source && i < lines; ++i)
+    {
+        free(source[i]);
+    }
+    free(source);
+    free(order);
+
+    /* fprintf() errors stick to the stream, so one check covers every write */
+    if (ferror(out))
+    {
+        ret = -1;
+    }
+    if (fclose(out))
+    {
+        ret = -1;
+    }
+    return ret;
+}
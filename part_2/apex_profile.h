@@ -0,0 +1,24 @@
+/*
+ * apex_profile.h
+ * Contains the per-instruction profiler of the APEX cpu pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+
+#include <stdint.h>
+
+/* Counters of one code memory entry */
+typedef struct APEX_Profile_Entry
+{
+    uint64_t executed;     /* Times retired */
+    uint64_t stall_cycles; /* Cycles stalled in Decode/RF */
+    uint64_t flush_cycles; /* Fetch cycles lost to its mispredicts */
+    uint64_t fetch_cycles; /* Cycles fetch waited on its I-cache misses */
+    uint64_t mem_accesses; /* Data memory reads and writes */
+} APEX_Profile_Entry;
+
+#endif
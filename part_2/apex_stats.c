@@ -0,0 +1,123 @@
+/*
+ * apex_stats.c
+ * Contains the performance counter reports of the APEX cpu pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_stats.h"
+
+static const char *const stage_names[NUM_STAGES] = {
+    "Fetch", "Decode/RF", "Execute", "Memory", "Writeback",
+};
+
+static const char *const cause_names[NUM_CYCLE_CAUSES] = {
+    "empty", "useful", "data", "flags", "structural", "memory", "fetch", "flush", "halt",
+};
+
+/*
+ * Prints the counters. The CPI stack is taken at Writeback: every cycle
+ * either retires an instruction or carries the cause of the bubble that
+ * reached it, so the stack adds up to the total CPI. A wider pipeline
+ * retires up to 'width' instructions in a useful cycle, which lowers the
+ * base component.
+ */
+void
+APEX_stats_print(const APEX_Stats *stats, int width)
+{
+    const uint64_t *retire = stats->stage_cycles[WB];
+    uint64_t cycles = 0;
+    uint64_t insns = 0;
+
+    for (int i = 0; i < NUM_CYCLE_CAUSES; ++i)
+    {
+        cycles += retire[i];
+    }
+
+    for (int i = 0; i < NUM_OPCODES; ++i)
+    {
+        insns += stats->opcode_retired[i];
+    }
+
+    printf("APEX_CPU: Cycles by stage and cause\n%-10s", "");
+    for (int i = 0; i < NUM_CYCLE_CAUSES; ++i)
+    {
+        printf(" %10s", cause_names[i]);
+    }
+    printf("\n");
+
+    for (int s = 0; s < NUM_STAGES; ++s)
+    {
+        printf("%-10s", stage_names[s]);
+        for (int i = 0; i < NUM_CYCLE_CAUSES; ++i)
+        {
+            printf(" %10llu", (unsigned long long)stats->stage_cycles[s][i]);
+        }
+        printf("\n");
+    }
+
+    if (!cycles || !insns)
+    {
+        return;
+    }
+
+    printf("APEX_CPU: IPC = %.3f CPI = %.3f\n", (double)insns / cycles, (double)cycles / insns);
+    printf("APEX_CPU: CPI stack:");
+    for (int i = 0; i < NUM_CYCLE_CAUSES; ++i)
+    {
+        if (retire[i])
+        {
+            printf(" %s %.3f", i == CYCLE_USEFUL ? "base" : cause_names[i],
+                   (double)retire[i] / insns);
+        }
+    }
+    printf("\n");
+
+    if (width > 1)
+    {
+        uint64_t groups = 0;
+        uint64_t issued = 0;
+
+        printf("APEX_CPU: Issue groups of width %d:", width);
+        for (int i = 0; i < width; ++i)
+        {
+            printf(" %d %llu", i + 1, (unsigned long long)stats->issue_groups[i]);
+            groups += stats->issue_groups[i];
+            issued += (i + 1) * stats->issue_groups[i];
+        }
+        printf(" (none %llu), slot utilization %.1f%%\n",
+               (unsigned long long)(cycles > groups ? cycles - groups : 0),
+               100.0 * issued / ((double)cycles * width));
+    }
+
+    printf("APEX_CPU: Decode/RF stalls: data %llu flags %llu structural %llu memory %llu\n",
+           (unsigned long long)stats->stage_cycles[DRF][CYCLE_DATA_STALL],
+           (unsigned long long)stats->stage_cycles[DRF][CYCLE_FLAG_STALL],
+           (unsigned long long)stats->stage_cycles[DRF][CYCLE_STRUCTURAL_STALL],
+           (unsigned long long)stats->stage_cycles[DRF][CYCLE_MEMORY_STALL]);
+    printf("APEX_CPU: Fetch stalls: I-cache %llu\n",
+           (unsigned long long)stats->stage_cycles[Fetch][CYCLE_FETCH_STALL]);
+    printf("APEX_CPU: Data stall cycles by register:");
+    for (int i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (stats->reg_stall_cycles[i])
+        {
+            printf(" R%d %llu", i, (unsigned long long)stats->reg_stall_cycles[i]);
+        }
+    }
+    printf("\n");
+
+    printf("APEX_CPU: Retired by opcode:");
+    for (int i = 0; i < NUM_OPCODES; ++i)
+    {
+        if (stats->opcode_retired[i])
+        {
+            printf(" %s %llu", get_opcode_str(i), (unsigned long long)stats->opcode_retired[i]);
+        }
+    }
+    printf("\n");
+}
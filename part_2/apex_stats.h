@@ -0,0 +1,47 @@
+/*
+ * apex_stats.h
+ * Contains the performance counters of the APEX cpu pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_STATS_H_
+#define _APEX_STATS_H_
+
+#include <stdint.h>
+
+#include "apex_macros.h"
+
+/* What a stage did in one cycle. An empty latch carries the cause of the
+ * bubble it holds, so a bubble is accounted to the same cause in every stage
+ * it passes through. */
+enum
+{
+    CYCLE_EMPTY,            /* Pipeline fill or nothing left to fetch */
+    CYCLE_USEFUL,           /* Worked on an instruction and passed it on */
+    CYCLE_DATA_STALL,       /* Waiting on a source register */
+    CYCLE_FLAG_STALL,       /* Waiting on the condition code flags */
+    CYCLE_STRUCTURAL_STALL, /* Next stage was busy */
+    CYCLE_MEMORY_STALL,     /* Waiting on a data cache miss */
+    CYCLE_FETCH_STALL,      /* Waiting on an instruction cache miss */
+    CYCLE_FLUSH,            /* Bubble of a mispredicted branch or jump */
+    CYCLE_HALT_DRAIN,       /* Fetch stopped by HALT */
+    NUM_CYCLE_CAUSES
+};
+
+typedef struct APEX_Stats
+{
+    uint64_t stage_cycles[NUM_STAGES][NUM_CYCLE_CAUSES];
+    uint64_t reg_stall_cycles[REG_FILE_SIZE]; /* Data stalls by blocking register */
+    uint64_t opcode_retired[NUM_OPCODES];     /* Instructions retired by opcode */
+    uint64_t issue_groups[APEX_MAX_WIDTH];    /* Cycles Decode/RF issued i + 1 insns */
+    uint64_t shared_accesses; /* Data accesses granted by a shared memory */
+    uint64_t bank_conflicts;  /* Cycles a data access lost its bank to another access */
+} APEX_Stats;
+
+/* Prints the CPI stack, IPC, stall totals and per-opcode counts, and the
+ * issue group sizes of a pipeline wider than one */
+void APEX_stats_print(const APEX_Stats *stats, int width);
+
+#endif
@@ -0,0 +1,643 @@
+/*
+ * apex_system.c
+ * Contains the multicore APEX system: several cpus sharing one data memory
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_macros.h"
+#include "apex_system.h"
+
+/* Host-parallel state of one core. Cores are stepped on different threads,
+ * so every core gets cache lines of its own. */
+typedef struct System_Core
+{
+    APEX_Mailbox mailbox;
+    int stall;  /* Bank conflict cycles still to be spent */
+    int worker; /* Thread stepping the core */
+} System_Core;
+
+#define SYSTEM_CORE_ALIGN 64
+#define SYSTEM_CORE_SIZE \
+    ((sizeof(System_Core) + SYSTEM_CORE_ALIGN - 1) / SYSTEM_CORE_ALIGN * SYSTEM_CORE_ALIGN)
+
+typedef struct System_Worker
+{
+    APEX_System *system;
+    int id;
+    pthread_t thread;
+} System_Worker;
+
+static System_Core *
+system_core(const APEX_System *system, int core)
+{
+    return (System_Core *)((char *)system->parallel + core * SYSTEM_CORE_SIZE);
+}
+
+void
+APEX_system_config_init(APEX_System_Config *config)
+{
+    config->num_cores = 2;
+    config->banks = 1;
+    config->core_id_reg = -1;
+    config->quantum = 1;
+    config->threads = 0;
+    APEX_config_init(&config->core);
+}
+
+APEX_System *
+APEX_system_create(const char *const *programs, int num_programs,
+                   const APEX_System_Config *config)
+{
+    APEX_System *system;
+
+    if (num_programs < 1 || config->num_cores < 1 || config->num_cores > APEX_MAX_CORES
+        || config->core_id_reg < -1 || config->core_id_reg >= REG_FILE_SIZE
+        || config->quantum < 1 || config->threads < 0)
+    {
+        return NULL;
+    }
+
+    system = calloc(1, sizeof(*system));
+    if (!system)
+    {
+        return NULL;
+    }
+
+    system->config = *config;
+    system->clock = 1;
+    pthread_mutex_init(&system->lock, NULL);
+    pthread_cond_init(&system->cond, NULL);
+    system->memory = APEX_shared_create(config->banks, config->core.hugepages);
+    if (!system->memory)
+    {
+        APEX_system_stop(system);
+        return NULL;
+    }
+
+    for (int i = 0; i < config->num_cores; ++i)
+    {
+        APEX_CPU *cpu = APEX_cpu_create(programs[i % num_programs], &config->core);
+
+        if (!cpu)
+        {
+            APEX_system_stop(system);
+            return NULL;
+        }
+
+        cpu->shared = system->memory;
+        cpu->core_id = i;
+        if (config->core_id_reg >= 0)
+        {
+            cpu->regs[config->core_id_reg] = i;
+        }
+        system->cores[i] = cpu;
+    }
+    return system;
+}
+
+int
+APEX_system_step(APEX_System *system)
+{
+    int num_cores = system->config.num_cores;
+    int first = system->clock % num_cores;
+    int running = 0;
+
+    for (int i = 0; i < num_cores; ++i)
+    {
+        APEX_CPU *cpu = system->cores[(first + i) % num_cores];
+
+        if (cpu->halted)
+        {
+            continue;
+        }
+
+        if (ENABLE_DEBUG_MESSAGES && cpu->config.trace)
+        {
+            printf("Core %d\n", cpu->core_id);
+        }
+
+        if (!APEX_cpu_step(cpu))
+        {
+            running++;
+        }
+    }
+
+    system->clock++;
+    return !running;
+}
+
+/*
+ * Applies the accesses of the quantum to the shared memory and charges the
+ * cycles they waited for their banks. Every bank serves its requests in
+ * order, one per cycle. A core did not wait while it ran, so each access is
+ * taken as made later by the waits of the earlier accesses of its core, and
+ * the accesses are served in the order of these cycles, ties in the
+ * round-robin order of the lockstep system.
+ */
+static void
+drain_mailboxes(APEX_System *system)
+{
+    int num_cores = system->config.num_cores;
+    int next[APEX_MAX_CORES] = {0};
+    int delay[APEX_MAX_CORES] = {0};
+
+    for (;;)
+    {
+        const APEX_Mailbox_Entry *entry;
+        int core = -1;
+        int when = 0;
+        int rank = 0;
+        int served;
+        int *bank;
+
+        for (int i = 0; i < num_cores; ++i)
+        {
+            const APEX_Mailbox *box = &system_core(system, i)->mailbox;
+            int cycle;
+            int order;
+
+            if (next[i] == box->count)
+            {
+                continue;
+            }
+
+            cycle = box->entries[next[i]].cycle + delay[i];
+            order = (i - cycle % num_cores + num_cores) % num_cores;
+            if (core < 0 || cycle < when || (cycle == when && order < rank))
+            {
+                core = i;
+                when = cycle;
+                rank = order;
+            }
+        }
+
+        if (core < 0)
+        {
+            break;
+        }
+
+        entry = &system_core(system, core)->mailbox.entries[next[core]++];
+        bank = &system->memory->bank_cycle[(unsigned)entry->address % system->memory->banks];
+        served = *bank < when ? when : *bank + 1;
+        delay[core] += served - when;
+        *bank = served;
+
+        if (entry->is_store)
+        {
+            APEX_shared_write(system->memory, entry->address, entry->value);
+        }
+    }
+
+    for (int i = 0; i < num_cores; ++i)
+    {
+        System_Core *sc = system_core(system, i);
+
+        sc->stall += delay[i];
+        system->cores[i]->stats.bank_conflicts += delay[i];
+        system->memory->memory.faults += sc->mailbox.faults;
+        sc->mailbox.faults = 0;
+        APEX_mailbox_clear(&sc->mailbox);
+    }
+}
+
+/*
+ * Ends the quantum that starts at system->clock after 'quantum' cycles, or
+ * after max_cycles, which may be INT_MAX
+ */
+static void
+start_quantum(APEX_System *system)
+{
+    long long end = (long long)system->clock + system->config.quantum;
+    long long limit = (long long)system->config.core.max_cycles + 1;
+
+    system->quantum_end = end < limit ? end : limit;
+}
+
+/*
+ * Serial part of the barrier, run by the last thread to arrive: publishes
+ * the quantum and sets up the next one
+ */
+static void
+end_quantum(APEX_System *system)
+{
+    int halted = 0;
+
+    drain_mailboxes(system);
+
+    for (int i = 0; i < system->config.num_cores; ++i)
+    {
+        halted += system->cores[i]->halted;
+    }
+
+    system->done = halted == system->config.num_cores
+                   || system->quantum_end > system->config.core.max_cycles;
+    if (!system->done)
+    {
+        system->clock = (int)system->quantum_end;
+        start_quantum(system);
+    }
+}
+
+/*
+ * Waits until every thread has finished the quantum. Returns FALSE once the
+ * run is over.
+ */
+static int
+quantum_barrier(APEX_System *system)
+{
+    int running;
+
+    pthread_mutex_lock(&system->lock);
+    if (++system->arrived == system->num_threads)
+    {
+        end_quantum(system);
+        system->arrived = 0;
+        system->generation++;
+        pthread_cond_broadcast(&system->cond);
+    }
+    else
+    {
+        int generation = system->generation;
+
+        while (generation == system->generation)
+        {
+            pthread_cond_wait(&system->cond, &system->lock);
+        }
+    }
+    running = !system->done;
+    pthread_mutex_unlock(&system->lock);
+    return running;
+}
+
+/* Steps a core up to the end of the quantum, spending its stalls first */
+static void
+run_quantum(APEX_System *system, int core)
+{
+    APEX_CPU *cpu = system->cores[core];
+    System_Core *sc = system_core(system, core);
+
+    while (!cpu->halted && cpu->clock < system->quantum_end)
+    {
+        if (sc->stall)
+        {
+            APEX_cpu_stall(cpu);
+            sc->stall--;
+            continue;
+        }
+        APEX_cpu_step(cpu);
+    }
+}
+
+static void *
+worker_main(void *arg)
+{
+    System_Worker *worker = arg;
+    APEX_System *system = worker->system;
+
+    do
+    {
+        for (int i = 0; i < system->config.num_cores; ++i)
+        {
+            if (system_core(system, i)->worker == worker->id)
+            {
+                run_quantum(system, i);
+            }
+        }
+    } while (quantum_barrier(system));
+    return NULL;
+}
+
+/*
+ * Runs the cores on their threads, one quantum at a time. The calling thread
+ * is worker 0 and takes over the cores of any thread that can not be
+ * started.
+ */
+static void
+run_parallel(APEX_System *system)
+{
+    int num_cores = system->config.num_cores;
+    int num_threads = system->config.threads ? system->config.threads : num_cores;
+    System_Worker workers[APEX_MAX_CORES];
+    int started[APEX_MAX_CORES] = {0};
+
+    if (num_threads > num_cores)
+    {
+        num_threads = num_cores;
+    }
+
+    system->parallel = aligned_alloc(SYSTEM_CORE_ALIGN, num_cores * SYSTEM_CORE_SIZE);
+    if (!system->parallel)
+    {
+        /* Fall back to lockstep */
+        while (system->clock <= system->config.core.max_cycles && !APEX_system_step(system))
+            ;
+        return;
+    }
+
+    for (int i = 0; i < num_cores; ++i)
+    {
+        System_Core *sc = system_core(system, i);
+
+        APEX_mailbox_init(&sc->mailbox);
+        sc->stall = 0;
+        sc->worker = i % num_threads;
+        system->cores[i]->mailbox = &sc->mailbox;
+    }
+
+    system->num_threads = num_threads;
+    system->arrived = 0;
+    start_quantum(system);
+    system->done = system->clock > system->config.core.max_cycles;
+
+    for (int t = 0; t < num_threads; ++t)
+    {
+        workers[t].system = system;
+        workers[t].id = t;
+    }
+
+    /* The threads can not finish a quantum without worker 0, so the cores
+     * of a thread that failed to start are handed over before it runs */
+    for (int t = 1; t < num_threads; ++t)
+    {
+        if (pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]) == 0)
+        {
+            started[t] = TRUE;
+            continue;
+        }
+
+        pthread_mutex_lock(&system->lock);
+        system->num_threads--;
+        pthread_mutex_unlock(&system->lock);
+        for (int i = 0; i < num_cores; ++i)
+        {
+            if (system_core(system, i)->worker == t)
+            {
+                system_core(system, i)->worker = 0;
+            }
+        }
+    }
+
+    worker_main(&workers[0]);
+
+    for (int t = 1; t < num_threads; ++t)
+    {
+        if (started[t])
+        {
+            pthread_join(workers[t].thread, NULL);
+        }
+    }
+
+    /* Back to stepping the shared memory directly */
+    system->clock = 1;
+    for (int i = 0; i < num_cores; ++i)
+    {
+        APEX_CPU *cpu = system->cores[i];
+        int cycles = cpu->halted ? cpu->clock : cpu->clock - 1;
+
+        if (cycles + 1 > system->clock)
+        {
+            system->clock = cycles + 1;
+        }
+        cpu->mailbox = NULL;
+        APEX_mailbox_free(&system_core(system, i)->mailbox);
+    }
+    free(system->parallel);
+    system->parallel = NULL;
+}
+
+void
+APEX_system_run(APEX_System *system)
+{
+    if (system->config.quantum > 1)
+    {
+        for (int i = 0; i < system->config.num_cores; ++i)
+        {
+            system->cores[i]->config.trace = FALSE;
+        }
+        run_parallel(system);
+    }
+    else
+    {
+        while (system->clock <= system->config.core.max_cycles)
+        {
+            if (APEX_system_step(system))
+            {
+                break;
+            }
+        }
+    }
+
+    if (system->config.core.display)
+    {
+        APEX_system_print_report(system);
+    }
+}
+
+void
+APEX_system_print_report(APEX_System *system)
+{
+    const APEX_Shared_Memory *memory = system->memory;
+    uint64_t accesses = 0;
+    uint64_t conflicts = 0;
+    int instructions = 0;
+    int halted = 0;
+
+    for (int i = 0; i < system->config.num_cores; ++i)
+    {
+        APEX_CPU *cpu = system->cores[i];
+
+        printf("APEX_CPU: Core %d %s, cycles = %d instructions = %d\n", i,
+               cpu->halted ? "halted" : "running", cpu->clock, cpu->insn_completed);
+        printf("Positive Flag: %d\nNegative Flag: %d\nZero Flag: %d\n", cpu->cc_flags.P,
+               cpu->cc_flags.N, cpu->cc_flags.Z);
+        APEX_cpu_print_report(cpu);
+    }
+
+    printf("APEX_CPU: Shared memory contention by core, banks = %d\n", memory->banks);
+    printf("%-6s %12s %12s %8s %12s %12s\n", "core", "cycles", "insns", "IPC", "accesses",
+           "conflicts");
+    for (int i = 0; i < system->config.num_cores; ++i)
+    {
+        const APEX_CPU *cpu = system->cores[i];
+
+        printf("%-6d %12d %12d %8.3f %12llu %12llu\n", i, cpu->clock, cpu->insn_completed,
+               cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0,
+               (unsigned long long)cpu->stats.shared_accesses,
+               (unsigned long long)cpu->stats.bank_conflicts);
+        accesses += cpu->stats.shared_accesses;
+        conflicts += cpu->stats.bank_conflicts;
+        instructions += cpu->insn_completed;
+        halted += cpu->halted;
+    }
+
+    printf("APEX_CPU: Accesses = %llu bank conflicts = %llu (%.1f%% of requests)\n",
+           (unsigned long long)accesses, (unsigned long long)conflicts,
+           accesses + conflicts ? 100.0 * conflicts / (accesses + conflicts) : 0.0);
+    if (memory->memory.pages || memory->memory.faults)
+    {
+        printf("APEX_CPU: Sparse data memory pages = %llu faults = %llu\n",
+               (unsigned long long)memory->memory.pages,
+               (unsigned long long)memory->memory.faults);
+    }
+    printf("APEX_CPU: Multicore simulation %s, cycles = %d instructions = %d, %d of %d cores halted\n",
+           halted == system->config.num_cores ? "complete" : "stopped", system->clock - 1,
+           instructions, halted, system->config.num_cores);
+    APEX_cpu_print_data_memory(system->cores[0]);
+}
+
+void
+APEX_system_stop(APEX_System *system)
+{
+    for (int i = 0; i < system->config.num_cores; ++i)
+    {
+        if (system->cores[i])
+        {
+            APEX_cpu_stop(system->cores[i]);
+        }
+    }
+
+    APEX_shared_free(system->memory);
+    pthread_mutex_destroy(&system->lock);
+    pthread_cond_destroy(&system->cond);
+    free(system);
+}
+
+static uint64_t
+hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= ((const unsigned char *)data)[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void
+hash_page(uint32_t page, const int32_t *words, void *arg)
+{
+    uint64_t *hash = arg;
+
+    *hash = hash_bytes(*hash, &page, sizeof(page));
+    *hash = hash_bytes(*hash, words, MEM_PAGE_WORDS * sizeof(*words));
+}
+
+/* FNV-1a hash of the registers and flags of every core and the shared
+ * memory, to compare the end state of two runs */
+static uint64_t
+state_hash(const APEX_System *system)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int i = 0; i < system->config.num_cores; ++i)
+    {
+        const APEX_CPU *cpu = system->cores[i];
+
+        hash = hash_bytes(hash, cpu->regs, sizeof(cpu->regs));
+        hash = hash_bytes(hash, &cpu->cc_flags, sizeof(cpu->cc_flags));
+        hash = hash_bytes(hash, &cpu->halted, sizeof(cpu->halted));
+    }
+    hash = hash_bytes(hash, system->memory->data_memory, sizeof(system->memory->data_memory));
+    APEX_mem_for_each_page(&system->memory->memory, hash_page, &hash);
+    return hash;
+}
+
+/* Result of one run of the quantum report */
+typedef struct Quantum_Run
+{
+    double seconds;
+    int cycles;
+    uint64_t conflicts;
+    uint64_t hash;
+} Quantum_Run;
+
+static int
+run_with_quantum(const char *const *programs, int num_programs,
+                 const APEX_System_Config *config, int quantum, Quantum_Run *run)
+{
+    APEX_System_Config run_config = *config;
+    struct timespec start, end;
+    APEX_System *system;
+
+    run_config.quantum = quantum;
+    run_config.core.trace = FALSE;
+    run_config.core.display = FALSE;
+
+    system = APEX_system_create(programs, num_programs, &run_config);
+    if (!system)
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    APEX_system_run(system);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    memset(run, 0, sizeof(*run));
+    run->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    run->cycles = system->clock - 1;
+    for (int i = 0; i < run_config.num_cores; ++i)
+    {
+        run->conflicts += system->cores[i]->stats.bank_conflicts;
+    }
+    run->hash = state_hash(system);
+    APEX_system_stop(system);
+    return 0;
+}
+
+static void
+print_quantum_run(int quantum, int threads, const Quantum_Run *run, const Quantum_Run *exact)
+{
+    printf("%-8d %8d %10.3f %10.2f %8.2f %12d %9.2f%% %12llu %10s\n", quantum, threads,
+           run->seconds, run->seconds > 0 ? run->cycles / run->seconds / 1e6 : 0.0,
+           run->seconds > 0 ? exact->seconds / run->seconds : 0.0, run->cycles,
+           exact->cycles ? 100.0 * (run->cycles - exact->cycles) / exact->cycles : 0.0,
+           (unsigned long long)run->conflicts, run->hash == exact->hash ? "same" : "differs");
+}
+
+int
+APEX_system_quantum_report(const char *const *programs, int num_programs,
+                           const APEX_System_Config *config, const int *quanta,
+                           int num_quanta)
+{
+    int threads = config->threads ? config->threads : config->num_cores;
+    Quantum_Run exact;
+    Quantum_Run run;
+
+    if (threads > config->num_cores)
+    {
+        threads = config->num_cores;
+    }
+
+    if (run_with_quantum(programs, num_programs, config, 1, &exact))
+    {
+        return -1;
+    }
+
+    printf("APEX_CPU: Quantum report of %d cores, against lockstep\n", config->num_cores);
+    printf("%-8s %8s %10s %10s %8s %12s %10s %12s %10s\n", "quantum", "threads", "host_s",
+           "Mcycles/s", "speedup", "cycles", "cycle_err", "conflicts", "state");
+    print_quantum_run(1, 1, &exact, &exact);
+
+    for (int i = 0; i < num_quanta; ++i)
+    {
+        if (quanta[i] <= 1)
+        {
+            continue;
+        }
+
+        if (run_with_quantum(programs, num_programs, config, quanta[i], &run))
+        {
+            return -1;
+        }
+        print_quantum_run(quanta[i], threads, &run, &exact);
+    }
+    return 0;
+}
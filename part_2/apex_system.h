@@ -0,0 +1,98 @@
+/*
+ * apex_system.h
+ * Contains the multicore APEX system: several cpus sharing one data memory
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_SYSTEM_H_
+#define _APEX_SYSTEM_H_
+
+#include <pthread.h>
+
+#include "apex_cpu.h"
+
+/* Most cores a system can be created with */
+#define APEX_MAX_CORES 64
+
+typedef struct APEX_System_Config
+{
+    int num_cores;
+    int banks;       /* Word interleaved banks of the shared data memory */
+    int core_id_reg; /* Register preset to the number of the core, or -1 */
+    int quantum;     /* Cycles between the barriers of a host-parallel run, 1 to
+                      * step the cores in exact lockstep on one thread */
+    int threads;     /* Host threads of a parallel run, 0 for one per core */
+    APEX_Config core; /* Configuration of every core, max_cycles and display
+                       * apply to the system */
+} APEX_System_Config;
+
+/* With a quantum of 1 the cores step in lockstep. In every cycle each bank of
+ * the shared memory serves one access, the cores are stepped and win the
+ * banks in round-robin order, starting one core later every cycle, so that a
+ * run is deterministic and no core starves. A core that loses its bank
+ * retries in the next cycle.
+ *
+ * With a longer quantum every thread runs its cores for a quantum on its
+ * own. Their accesses go to a mailbox per core, and stores are only seen by
+ * the core that made them. At the barrier that ends the quantum the
+ * mailboxes are drained cycle by cycle in the same round-robin order: stores
+ * reach the shared memory, and each bank serves the accesses one per cycle.
+ * The cycles an access waited for its bank stall its core at the start of
+ * the next quantum. The result does not depend on the number of threads, but
+ * it is only an approximation of the lockstep run, see
+ * APEX_system_quantum_report(). */
+typedef struct APEX_System
+{
+    APEX_System_Config config;
+    APEX_CPU *cores[APEX_MAX_CORES];
+    APEX_Shared_Memory *memory;
+    int clock;
+
+    /* Host-parallel run */
+    struct System_Core *parallel; /* Mailbox, stall and thread of each core */
+    int num_threads;              /* Threads meeting at the barrier */
+    long long quantum_end;        /* First cycle after the current quantum */
+    int done;
+    int arrived;                  /* Threads waiting at the barrier */
+    int generation;               /* Quanta completed */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} APEX_System;
+
+/* Fills 'config' with defaults: 2 cores, one bank, no core id register, a
+ * quantum of 1 and the APEX_config_init() defaults for the cores */
+void APEX_system_config_init(APEX_System_Config *config);
+
+/* Creates the cores, core i running programs[i % num_programs], on a zeroed
+ * shared memory. Returns NULL if a program can not be loaded or the
+ * configuration is invalid. */
+APEX_System *APEX_system_create(const char *const *programs, int num_programs,
+                                const APEX_System_Config *config);
+
+/* Simulates one clock cycle of every core that has not halted. Returns TRUE
+ * once all of them have. */
+int APEX_system_step(APEX_System *system);
+
+/* Steps the system until every core halts or config.core.max_cycles is
+ * reached, then prints the report if config.core.display is set. A quantum
+ * longer than 1 runs the cores on config.threads threads, without trace. */
+void APEX_system_run(APEX_System *system);
+
+/* Prints the report of every core, the memory contention of each core and the
+ * start of the shared data memory */
+void APEX_system_print_report(APEX_System *system);
+
+void APEX_system_stop(APEX_System *system);
+
+/* Runs the programs once in lockstep and once with each of the 'num_quanta'
+ * quanta, and prints the host time and speedup of every run next to its error
+ * against the lockstep run: the difference in cycles and whether the
+ * registers, flags and shared memory it ends with are the same. Returns -1 if
+ * the system can not be created. */
+int APEX_system_quantum_report(const char *const *programs, int num_programs,
+                               const APEX_System_Config *config, const int *quanta,
+                               int num_quanta);
+
+#endif
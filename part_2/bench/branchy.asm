@@ -0,0 +1,11 @@
+MOVC R15,#1000
+MOVC R1,#1
+MOVC R2,#0
+MOVC R3,#0
+EXOR R2,R2,R1
+CML R2,#0
+BZ #8
+ADDL R3,R3,#1
+SUB R15,R15,R1
+BNZ #-20
+HALT
@@ -0,0 +1,11 @@
+MOVC R15,#1000
+MOVC R1,#1
+MOVC R2,#3
+ADD R3,R2,R1
+MUL R4,R3,R2
+SUB R5,R4,R3
+ADD R6,R5,R4
+EXOR R7,R6,R5
+SUB R15,R15,R1
+BNZ #-24
+HALT
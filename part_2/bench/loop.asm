@@ -0,0 +1,5 @@
+MOVC R15,#1000
+MOVC R1,#1
+SUB R15,R15,R1
+BNZ #-4
+HALT
@@ -0,0 +1,13 @@
+MOVC R15,#1000
+MOVC R1,#1
+MOVC R2,#0
+MOVC R5,#4092
+MOVC R6,#2048
+LOADP R3,R2,#0
+ADD R3,R3,R1
+STOREP R3,R6,#0
+AND R2,R2,R5
+AND R6,R6,R5
+SUB R15,R15,R1
+BNZ #-24
+HALT
@@ -8,354 +8,650 @@
  * State University of New York at Binghamton
  */
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
+/* Mnemonics indexed by numeric opcode, the reverse of set_opcode_str() */
+static const char *const opcode_names[NUM_OPCODES] = {
+    [OPCODE_ADD] = "ADD",     [OPCODE_SUB] = "SUB",       [OPCODE_MUL] = "MUL",
+    [OPCODE_DIV] = "DIV",     [OPCODE_AND] = "AND",       [OPCODE_OR] = "OR",
+    [OPCODE_XOR] = "EXOR",    [OPCODE_MOVC] = "MOVC",     [OPCODE_LOAD] = "LOAD",
+    [OPCODE_STORE] = "STORE", [OPCODE_BZ] = "BZ",         [OPCODE_BNZ] = "BNZ",
+    [OPCODE_HALT] = "HALT",   [OPCODE_ADDL] = "ADDL",     [OPCODE_SUBL] = "SUBL",
+    [OPCODE_NOP] = "NOP",     [OPCODE_LOADP] = "LOADP",   [OPCODE_STOREP] = "STOREP",
+    [OPCODE_CML] = "CML",     [OPCODE_CMP] = "CMP",       [OPCODE_BP] = "BP",
+    [OPCODE_BNP] = "BNP",     [OPCODE_BN] = "BN",         [OPCODE_BNN] = "BNN",
+    [OPCODE_JUMP] = "JUMP",   [OPCODE_JALR] = "JALR",
+};
+
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * This function returns the mnemonic of a numeric opcode. Latches only carry
+ * the numeric opcode, the string is reconstructed here for display.
  */
-static int
-get_num_from_string(const char *buffer)
+const char *
+get_opcode_str(const int opcode)
 {
-    char str[16];
-    int i, j = 0;
-
-    for (i = 1; buffer[i] != '\0'; ++i)
+    if (opcode < 0 || opcode >= NUM_OPCODES)
     {
-        str[j] = buffer[i];
-        j++;
+        return "???";
     }
-    str[j] = '\0';
-
-    return atoi(str);
+    return opcode_names[opcode];
 }
 
 /*
- * This function sets the numeric opcode to an instruction based on string value
+ * This function returns the INSN_* class bits of an opcode. The pipeline
+ * stages dispatch on these bits instead of comparing opcode strings.
  *
  * Note : you can edit this function to add new instructions
  */
 static int
-set_opcode_str(const char *opcode_str)
+get_insn_flags(const int opcode)
 {
-    if (strcmp(opcode_str, "ADD") == 0)
+    switch (opcode)
     {
-        return OPCODE_ADD;
-    }
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        {
+            return INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RD | INSN_SETS_FLAGS;
+        }
 
-    if (strcmp(opcode_str, "SUB") == 0)
-    {
-        return OPCODE_SUB;
-    }
+        case OPCODE_MOVC:
+        {
+            return INSN_WRITES_RD | INSN_SETS_FLAGS;
+        }
 
-    if (strcmp(opcode_str, "MUL") == 0)
-    {
-        return OPCODE_MUL;
-    }
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        {
+            return INSN_READS_RS1 | INSN_WRITES_RD | INSN_SETS_FLAGS;
+        }
 
-    if (strcmp(opcode_str, "DIV") == 0)
-    {
-        return OPCODE_DIV;
-    }
+        case OPCODE_LOAD:
+        {
+            return INSN_READS_RS1 | INSN_WRITES_RD | INSN_IS_LOAD;
+        }
 
-    if (strcmp(opcode_str, "AND") == 0)
-    {
-        return OPCODE_AND;
-    }
+        case OPCODE_LOADP:
+        {
+            return INSN_READS_RS1 | INSN_WRITES_RD | INSN_WRITES_RS1 | INSN_IS_LOAD;
+        }
 
-    if (strcmp(opcode_str, "OR") == 0)
-    {
-        return OPCODE_OR;
-    }
+        case OPCODE_STORE:
+        {
+            return INSN_READS_RS1 | INSN_READS_RS2 | INSN_IS_STORE;
+        }
 
-    if (strcmp(opcode_str, "EXOR") == 0)
-    {
-        return OPCODE_XOR;
-    }
+        case OPCODE_STOREP:
+        {
+            return INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RS2 | INSN_IS_STORE;
+        }
 
-    if (strcmp(opcode_str, "MOVC") == 0)
-    {
-        return OPCODE_MOVC;
-    }
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            return INSN_IS_BRANCH;
+        }
 
-    if (strcmp(opcode_str, "LOAD") == 0)
-    {
-        return OPCODE_LOAD;
-    }
+        case OPCODE_CMP:
+        {
+            return INSN_READS_RS1 | INSN_READS_RS2 | INSN_SETS_FLAGS;
+        }
 
-    if (strcmp(opcode_str, "STORE") == 0)
-    {
-        return OPCODE_STORE;
-    }
+        case OPCODE_CML:
+        {
+            return INSN_READS_RS1 | INSN_SETS_FLAGS;
+        }
 
-    if (strcmp(opcode_str, "BZ") == 0)
-    {
-        return OPCODE_BZ;
-    }
+        case OPCODE_JUMP:
+        {
+            return INSN_READS_RS1 | INSN_IS_JUMP;
+        }
 
-    if (strcmp(opcode_str, "BNZ") == 0)
-    {
-        return OPCODE_BNZ;
-    }
+        case OPCODE_JALR:
+        {
+            return INSN_READS_RS1 | INSN_WRITES_RD | INSN_IS_JUMP;
+        }
 
-    if (strcmp(opcode_str, "HALT") == 0)
-    {
-        return OPCODE_HALT;
+        case OPCODE_HALT:
+        {
+            return INSN_IS_HALT;
+        }
     }
 
-    if (strcmp(opcode_str, "ADDL") == 0)
-    {
-        return OPCODE_ADDL;
-    }
+    return 0;
+}
 
-    if (strcmp(opcode_str, "SUBL") == 0)
-    {
-        return OPCODE_SUBL;
-    }
+/*
+ * This function derives the scoreboard bits an instruction reads and writes
+ * from its class bits, so the decode stage can test readiness with one AND
+ */
+static void
+set_scoreboard_masks(APEX_Instruction *ins)
+{
+    ins->src_mask = 0;
+    ins->dst_mask = 0;
 
-    if (strcmp(opcode_str, "NOP") == 0)
+    if (ins->flags & INSN_READS_RS1)
     {
-        return OPCODE_NOP;
+        ins->src_mask |= 1u << ins->rs1;
     }
 
-    if (strcmp(opcode_str, "LOADP") == 0)
+    if (ins->flags & INSN_READS_RS2)
     {
-        return OPCODE_LOADP;
+        ins->src_mask |= 1u << ins->rs2;
     }
 
-    if (strcmp(opcode_str, "STOREP") == 0)
+    if (ins->flags & INSN_IS_BRANCH)
     {
-        return OPCODE_STOREP;
+        ins->src_mask |= 1u << CC_FLAGS_REG;
     }
 
-    if (strcmp(opcode_str, "CML") == 0)
+    if (ins->flags & INSN_WRITES_RD)
     {
-        return OPCODE_CML;
+        ins->dst_mask |= 1u << ins->rd;
     }
 
-    if (strcmp(opcode_str, "CMP") == 0)
+    if (ins->flags & INSN_WRITES_RS1)
     {
-        return OPCODE_CMP;
+        ins->dst_mask |= 1u << ins->rs1;
     }
 
-    if (strcmp(opcode_str, "BP") == 0)
+    if (ins->flags & INSN_WRITES_RS2)
     {
-        return OPCODE_BP;
+        ins->dst_mask |= 1u << ins->rs2;
     }
 
-    if (strcmp(opcode_str, "BNP") == 0)
+    if (ins->flags & INSN_SETS_FLAGS)
     {
-        return OPCODE_BNP;
+        ins->dst_mask |= 1u << CC_FLAGS_REG;
     }
+}
 
-    if (strcmp(opcode_str, "BN") == 0)
-    {
-        return OPCODE_BN;
-    }
+/*
+ * Perfect hash of the mnemonics. A mnemonic of up to 8 characters is packed
+ * into a 64 bit key, first character in the low byte, and its slot is the top
+ * OPCODE_HASH_BITS bits of key * OPCODE_HASH_MULTIPLIER. tools/opcode_hash
+ * searches the multiplier that gives every mnemonic of opcode_names a slot of
+ * its own and writes the table below, "make check" verifies it.
+ *
+ * Note : after adding an instruction, run "make opcode-hash" or the new
+ * mnemonic will be reported as unknown
+ */
+#define MNEMONIC_MAX_LEN 8
+
+/* Generated by tools/opcode_hash, run "make opcode-hash" after changing opcode_names */
+#define OPCODE_HASH_BITS 5
+#define OPCODE_HASH_MULTIPLIER 0xb62bcf3fa043589bull
+
+/* Opcode of each slot, unused slots hold OPCODE_ADD and fail the compare */
+static const uint8_t opcode_slots[1 << OPCODE_HASH_BITS] = {
+    [0] = 0x11, /* STOREP */
+    [1] = 0x01, /* SUB */
+    [2] = 0x15, /* BNP */
+    [3] = 0x08, /* LOAD */
+    [5] = 0x0b, /* BNZ */
+    [6] = 0x10, /* LOADP */
+    [7] = 0x05, /* OR */
+    [10] = 0x16, /* BN */
+    [11] = 0x0a, /* BZ */
+    [12] = 0x12, /* CML */
+    [13] = 0x18, /* JUMP */
+    [14] = 0x17, /* BNN */
+    [15] = 0x06, /* EXOR */
+    [16] = 0x03, /* DIV */
+    [18] = 0x07, /* MOVC */
+    [19] = 0x13, /* CMP */
+    [20] = 0x04, /* AND */
+    [21] = 0x14, /* BP */
+    [22] = 0x19, /* JALR */
+    [24] = 0x0c, /* HALT */
+    [25] = 0x0f, /* NOP */
+    [26] = 0x0d, /* ADDL */
+    [27] = 0x02, /* MUL */
+    [29] = 0x0e, /* SUBL */
+    [30] = 0x00, /* ADD */
+    [31] = 0x09, /* STORE */
+};
+/* End of generated code */
+
+/*
+ * This function sets the numeric opcode to an instruction based on the
+ * mnemonic of 'len' characters at 'str'. Returns -1 for an unknown mnemonic.
+ */
+int
+set_opcode_str(const char *str, size_t len)
+{
+    uint64_t key = 0;
+    const char *name;
+    size_t i;
+    int opcode;
 
-    if (strcmp(opcode_str, "BNN") == 0)
+    if (len == 0 || len > MNEMONIC_MAX_LEN)
     {
-        return OPCODE_BNN;
+        return -1;
     }
 
-    if (strcmp(opcode_str, "JUMP") == 0)
+    for (i = 0; i < len; ++i)
     {
-        return OPCODE_JUMP;
+        key |= (uint64_t)(unsigned char)str[i] << (8 * i);
     }
 
-    if (strcmp(opcode_str, "JALR") == 0)
+    opcode = opcode_slots[(key * OPCODE_HASH_MULTIPLIER) >> (64 - OPCODE_HASH_BITS)];
+    name = opcode_names[opcode];
+    if (strncmp(name, str, len) != 0 || name[len] != '\0')
     {
-        return OPCODE_JALR;
+        return -1;
     }
+    return opcode;
+}
 
-    //assert(0 && "Invalid opcode");
-    return 0;
+/*
+ * Operands of each instruction in the order they are written: 'd' is the
+ * destination register rd, '1' and '2' the source registers rs1 and rs2, and
+ * 'i' the literal imm.
+ *
+ * Note : you can edit this table to add new instructions
+ */
+static const char *const operand_formats[NUM_OPCODES] = {
+    [OPCODE_ADD] = "d12",   [OPCODE_SUB] = "d12",    [OPCODE_MUL] = "d12",
+    [OPCODE_DIV] = "d12",   [OPCODE_AND] = "d12",    [OPCODE_OR] = "d12",
+    [OPCODE_XOR] = "d12",   [OPCODE_MOVC] = "di",    [OPCODE_LOAD] = "d1i",
+    [OPCODE_STORE] = "12i", [OPCODE_BZ] = "i",       [OPCODE_BNZ] = "i",
+    [OPCODE_HALT] = "",     [OPCODE_ADDL] = "d1i",   [OPCODE_SUBL] = "d1i",
+    [OPCODE_NOP] = "",      [OPCODE_LOADP] = "d1i",  [OPCODE_STOREP] = "12i",
+    [OPCODE_CML] = "1i",    [OPCODE_CMP] = "12",     [OPCODE_BP] = "i",
+    [OPCODE_BNP] = "i",     [OPCODE_BN] = "i",       [OPCODE_BNN] = "i",
+    [OPCODE_JUMP] = "1i",   [OPCODE_JALR] = "d1i",
+};
+
+/* Position of the parser in the input file */
+typedef struct Parser
+{
+    const char *filename;
+    const char *pos;
+    const char *end;
+    const char *line_start;
+    int line;
+} Parser;
+
+/*
+ * This function reports a malformed line at 'at' as file:line:column, the
+ * column counting from 1
+ */
+static void
+parse_error(const Parser *parser, const char *at, const char *msg)
+{
+    fprintf(stderr, "APEX_Error: %s:%d:%d: %s\n", parser->filename, parser->line,
+            (int)(at - parser->line_start) + 1, msg);
+}
+
+static int
+at_line_end(const Parser *parser)
+{
+    return parser->pos == parser->end || *parser->pos == '\n' || *parser->pos == '\r';
 }
 
 static void
-split_opcode_from_insn_string(char *buffer, char tokens[2][128])
+skip_blanks(Parser *parser)
 {
-    int token_num = 0;
+    while (parser->pos < parser->end && (*parser->pos == ' ' || *parser->pos == '\t'))
+    {
+        parser->pos++;
+    }
+}
 
-    char *token = strtok(buffer, " ");
+/*
+ * This function parses the number after the 'R' or '#' of an operand into
+ * 'value', accepting a sign only for literals. Returns 0 if there is no
+ * number or it does not fit in an int.
+ */
+static int
+parse_number(Parser *parser, int is_literal, long long *value)
+{
+    const char *start;
+    int negative = FALSE;
 
-    while (token != NULL)
+    *value = 0;
+    if (is_literal && parser->pos < parser->end
+        && (*parser->pos == '-' || *parser->pos == '+'))
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, " ");
+        negative = *parser->pos == '-';
+        parser->pos++;
+    }
+
+    start = parser->pos;
+    while (parser->pos < parser->end && *parser->pos >= '0' && *parser->pos <= '9')
+    {
+        *value = *value * 10 + (*parser->pos - '0');
+        if (*value > (long long)INT_MAX + 1)
+        {
+            return 0;
+        }
+        parser->pos++;
     }
+
+    if (negative)
+    {
+        *value = -*value;
+    }
+    return parser->pos != start && *value <= INT_MAX && *value >= INT_MIN;
 }
 
 /*
- * This function is related to parsing input file
+ * This function parses one line holding an instruction into 'ins'. Returns 0
+ * and reports the line if it is malformed.
  *
  * Note : you can edit this function to add new instructions
  */
-static void
-create_APEX_instruction(APEX_Instruction *ins, char *buffer)
+static int
+create_APEX_instruction(Parser *parser, APEX_Instruction *ins)
 {
-    int i, token_num = 0;
-    char tokens[6][128];
-    char top_level_tokens[2][128];
+    const char *start = parser->pos;
+    const char *format;
+    long long value;
+    int opcode;
 
-    for (i = 0; i < 2; ++i)
+    while (parser->pos < parser->end && *parser->pos >= 'A' && *parser->pos <= 'Z')
     {
-        strcpy(top_level_tokens[i], "");
+        parser->pos++;
     }
 
-    split_opcode_from_insn_string(buffer, top_level_tokens);
-
-    char *token = strtok(top_level_tokens[1], ",");
-
-    while (token != NULL)
+    opcode = set_opcode_str(start, parser->pos - start);
+    if (opcode < 0 || (!at_line_end(parser) && *parser->pos != ' ' && *parser->pos != '\t'))
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, ",");
+        parse_error(parser, start, "unknown instruction");
+        return 0;
     }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+    memset(ins, 0, sizeof(*ins));
+    ins->opcode = opcode;
+    ins->flags = get_insn_flags(opcode);
 
-    switch (ins->opcode)
+    for (format = operand_formats[opcode]; *format; ++format)
     {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
+        const char *operand;
+        int is_literal = *format == 'i';
+
+        skip_blanks(parser);
+        if (format != operand_formats[opcode])
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            break;
+            if (parser->pos == parser->end || *parser->pos != ',')
+            {
+                parse_error(parser, parser->pos, "expected ',' and another operand");
+                return 0;
+            }
+            parser->pos++;
+            skip_blanks(parser);
         }
 
-        case OPCODE_MOVC:
+        operand = parser->pos;
+        if (parser->pos == parser->end || *parser->pos != (is_literal ? '#' : 'R'))
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
+            parse_error(parser, operand, is_literal ? "expected a literal #<value>"
+                                                    : "expected a register R<n>");
+            return 0;
         }
+        parser->pos++;
 
-        case OPCODE_LOAD:
-        case OPCODE_LOADP:
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_JALR:
+        if (!parse_number(parser, is_literal, &value))
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
+            parse_error(parser, operand, is_literal ? "malformed or out of range literal"
+                                                    : "malformed register");
+            return 0;
         }
 
-        case OPCODE_STORE:
-        case OPCODE_STOREP:
+        if (!is_literal && value >= REG_FILE_SIZE)
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
+            parse_error(parser, operand, "register out of range");
+            return 0;
         }
 
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        case OPCODE_BN:
-        case OPCODE_BNN:
+        switch (*format)
         {
-            ins->imm = get_num_from_string(tokens[0]);
-            break;
+            case 'd':
+            {
+                ins->rd = value;
+                break;
+            }
+
+            case '1':
+            {
+                ins->rs1 = value;
+                break;
+            }
+
+            case '2':
+            {
+                ins->rs2 = value;
+                break;
+            }
+
+            default:
+            {
+                ins->imm = value;
+                break;
+            }
         }
+    }
 
-        case OPCODE_HALT:
-        case OPCODE_NOP:
+    skip_blanks(parser);
+    if (!at_line_end(parser))
+    {
+        parse_error(parser, parser->pos, *operand_formats[opcode]
+                                             ? "unexpected text after the last operand"
+                                             : "instruction takes no operands");
+        return 0;
+    }
+
+    set_scoreboard_masks(ins);
+    return 1;
+}
+
+/*
+ * This function maps the whole of 'fd' into memory. Files that can not be
+ * mapped, such as pipes, are read into a buffer instead and '*mapped' is
+ * cleared. Returns NULL on failure, or if the file is empty.
+ */
+static char *
+read_input_file(int fd, size_t *len, int *mapped)
+{
+    struct stat st;
+    char *buffer = NULL;
+    size_t capacity = 0;
+    ssize_t nread;
+
+    *len = 0;
+    *mapped = FALSE;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        buffer = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buffer != MAP_FAILED)
         {
-            break;
+            madvise(buffer, st.st_size, MADV_SEQUENTIAL);
+            *len = st.st_size;
+            *mapped = TRUE;
+            return buffer;
         }
+        buffer = NULL;
+    }
 
-        case OPCODE_CMP:
+    for (;;)
+    {
+        if (*len == capacity)
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            break;
+            char *grown;
+
+            capacity = capacity ? 2 * capacity : 1 << 16;
+            grown = realloc(buffer, capacity);
+            if (!grown)
+            {
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
         }
 
-        case OPCODE_JUMP:
-        case OPCODE_CML:
+        nread = read(fd, buffer + *len, capacity - *len);
+        if (nread < 0)
+        {
+            free(buffer);
+            return NULL;
+        }
+        if (nread == 0)
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
             break;
         }
+        *len += nread;
+    }
+
+    if (*len == 0)
+    {
+        free(buffer);
+        return NULL;
     }
-    /* Fill in rest of the instructions accordingly */
+    return buffer;
 }
 
 /*
  * This function is related to parsing input file
  *
- * Note : You are not supposed to edit this function
+ * Every line holds one instruction, at address 4000 + 4 * (line - 1). The
+ * file is read in one pass into a code memory that doubles as it fills, and
+ * the first malformed line is reported with its line and column. Blank lines
+ * are only allowed at the end of the file, where they add no instructions.
  */
 APEX_Instruction *
 create_code_memory(const char *filename, int *size)
 {
-    FILE *fp;
-    size_t nread;
-    size_t len = 0;
-    char *line = NULL;
-    int code_memory_size = 0;
-    int current_instruction = 0;
-    APEX_Instruction *code_memory;
-
+    APEX_Instruction *code_memory = NULL;
+    Parser parser;
+    size_t len;
+    int capacity = 0;
+    int count = 0;
+    int blank_line = 0;
+    int mapped;
+    int ok = TRUE;
+    char *text;
+    int fd;
+
+    *size = 0;
     if (!filename)
     {
         return NULL;
     }
 
-    fp = fopen(filename, "r");
-    if (!fp)
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    text = read_input_file(fd, &len, &mapped);
+    close(fd);
+    if (!text)
     {
         return NULL;
     }
 
-    while ((nread = getline(&line, &len, fp)) != -1)
+    parser.filename = filename;
+    parser.pos = text;
+    parser.end = text + len;
+    parser.line = 0;
+
+    while (ok && parser.pos < parser.end)
+    {
+        parser.line++;
+        parser.line_start = parser.pos;
+        skip_blanks(&parser);
+
+        if (at_line_end(&parser))
+        {
+            if (!blank_line)
+            {
+                blank_line = parser.line;
+            }
+        }
+        else if (blank_line)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: blank line inside the program\n",
+                    filename, blank_line);
+            ok = FALSE;
+            break;
+        }
+        else
+        {
+            if (count == capacity)
+            {
+                APEX_Instruction *grown;
+
+                capacity = capacity ? 2 * capacity : 1024;
+                grown = realloc(code_memory, capacity * sizeof(APEX_Instruction));
+                if (!grown)
+                {
+                    ok = FALSE;
+                    break;
+                }
+                code_memory = grown;
+            }
+
+            ok = create_APEX_instruction(&parser, &code_memory[count++]);
+        }
+
+        /* Move to the start of the next line */
+        while (parser.pos < parser.end && *parser.pos != '\n')
+        {
+            parser.pos++;
+        }
+        if (parser.pos < parser.end)
+        {
+            parser.pos++;
+        }
+    }
+
+    if (mapped)
     {
-        code_memory_size++;
+        munmap(text, len);
     }
-    *size = code_memory_size;
-    if (!code_memory_size)
+    else
     {
-        fclose(fp);
-        return NULL;
+        free(text);
     }
 
-    code_memory = calloc(code_memory_size, sizeof(APEX_Instruction));
-    if (!code_memory)
+    if (!ok || !count)
     {
-        fclose(fp);
+        free(code_memory);
         return NULL;
     }
 
-    rewind(fp);
-    while ((nread = getline(&line, &len, fp)) != -1)
+    /* Give back the unused part of the last doubling */
+    if (count < capacity)
     {
-        create_APEX_instruction(&code_memory[current_instruction], line);
-        current_instruction++;
+        APEX_Instruction *shrunk = realloc(code_memory, count * sizeof(APEX_Instruction));
+
+        if (shrunk)
+        {
+            code_memory = shrunk;
+        }
     }
 
-    free(line);
-    fclose(fp);
+    *size = count;
     return code_memory;
-}
\ No newline at end of file
+}
@@ -7,28 +7,413 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "apex_batch.h"
 #include "apex_cpu.h"
+#include "apex_system.h"
+
+/*
+ * Runs the comma separated 'programs' on a multicore system, core i runs
+ * program i modulo their number. With a comma separated list of quanta in
+ * 'quantum_report' the runs of the quantum report are made instead.
+ */
+static int
+run_multicore(const char *programs, APEX_System_Config *config, int quiet,
+              const char *quantum_report)
+{
+    const char *files[APEX_MAX_CORES];
+    char *list = strdup(programs);
+    int num_files = 0;
+    struct timespec start, end;
+    APEX_System *system;
+
+    if (!list)
+    {
+        return 1;
+    }
+
+    for (char *file = strtok(list, ","); file && num_files < APEX_MAX_CORES;
+         file = strtok(NULL, ","))
+    {
+        files[num_files++] = file;
+    }
+
+    if (quantum_report)
+    {
+        int quanta[64];
+        int num_quanta = 0;
+        int status = 0;
+
+        for (const char *q = quantum_report; num_quanta < 64; ++q)
+        {
+            char *end;
+
+            quanta[num_quanta++] = (int)strtol(q, &end, 10);
+            if (*end != ',')
+            {
+                break;
+            }
+            q = end;
+        }
+
+        if (APEX_system_quantum_report(files, num_files, config, quanta, num_quanta))
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize multicore system\n");
+            status = 1;
+        }
+        free(list);
+        return status;
+    }
+
+    if (quiet)
+    {
+        config->core.trace = FALSE;
+    }
+
+    system = APEX_system_create(files, num_files, config);
+    if (!system)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize multicore system\n");
+        free(list);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    APEX_system_run(system);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (quiet)
+    {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        fprintf(stderr, "APEX_CPU: Host time %.3f s, %.2f M cycles/s\n", seconds,
+                seconds > 0 ? (system->clock - 1) / seconds / 1e6 : 0.0);
+    }
+
+    APEX_system_stop(system);
+    free(list);
+    return 0;
+}
 
 int
 main(int argc, char const *argv[])
 {
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (argc != 4)
+    if (argc >= 3 && strcmp(argv[1], "batch") == 0)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file> simulate <cycles>\n", argv[0]);
+        const char *output = NULL;
+        int num_threads = 0;
+
+        for (int i = 3; i + 1 < argc; i += 2)
+        {
+            if (strcmp(argv[i], "--jobs") == 0)
+            {
+                num_threads = atoi(argv[i + 1]);
+            }
+            else if (strcmp(argv[i], "--output") == 0)
+            {
+                output = argv[i + 1];
+            }
+        }
+
+        int ret = APEX_batch_run(argv[2], num_threads, output);
+        if (ret == -2)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write batch output %s\n", output);
+            exit(1);
+        }
+        if (ret)
+        {
+            fprintf(stderr, "APEX_Error: Unable to run batch manifest %s\n", argv[2]);
+            exit(1);
+        }
+        return 0;
+    }
+
+    const char *positional[4];
+    const char *checkpoint_save = NULL;
+    const char *checkpoint_restore = NULL;
+    const char *profile = NULL;
+    const char *quantum_report = NULL;
+    int num_positional = 0;
+    int quiet = FALSE;
+    APEX_System_Config system_config;
+    APEX_Config config;
+
+    APEX_system_config_init(&system_config);
+    APEX_config_init(&config);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--checkpoint-save") == 0 && i + 1 < argc)
+        {
+            checkpoint_save = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoint-restore") == 0 && i + 1 < argc)
+        {
+            checkpoint_restore = argv[++i];
+        }
+        else if (strcmp(argv[i], "--btb") == 0 && i + 1 < argc)
+        {
+            config.btb_entries = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--btb-ways") == 0 && i + 1 < argc)
+        {
+            config.btb_ways = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--icache") == 0 && i + 1 < argc)
+        {
+            if (APEX_cache_config_parse(&config.icache, argv[++i]))
+            {
+                fprintf(stderr, "APEX_Error: Invalid I-cache configuration %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--dcache") == 0 && i + 1 < argc)
+        {
+            if (APEX_cache_config_parse(&config.dcache, argv[++i]))
+            {
+                fprintf(stderr, "APEX_Error: Invalid D-cache configuration %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--fu") == 0 && i + 1 < argc)
+        {
+            if (APEX_fu_config_parse(config.fu, argv[++i]))
+            {
+                fprintf(stderr, "APEX_Error: Invalid functional unit configuration %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--parallel-units") == 0)
+        {
+            config.parallel_units = TRUE;
+        }
+        else if (strcmp(argv[i], "--wb-arbiter") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "oldest") == 0)
+            {
+                config.fu_arbiter = FU_ARBITER_OLDEST;
+            }
+            else if (strcmp(argv[i], "priority") == 0)
+            {
+                config.fu_arbiter = FU_ARBITER_PRIORITY;
+            }
+            else
+            {
+                fprintf(stderr, "APEX_Error: Unknown writeback arbiter %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+        {
+            config.width = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "inorder") == 0)
+            {
+                config.engine = APEX_ENGINE_INORDER;
+            }
+            else if (strcmp(argv[i], "ooo") == 0)
+            {
+                config.engine = APEX_ENGINE_OOO;
+            }
+            else
+            {
+                fprintf(stderr, "APEX_Error: Unknown engine %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--rob") == 0 && i + 1 < argc)
+        {
+            config.rob_size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--iq") == 0 && i + 1 < argc)
+        {
+            config.iq_size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--banks") == 0 && i + 1 < argc)
+        {
+            system_config.banks = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--core-id-reg") == 0 && i + 1 < argc)
+        {
+            system_config.core_id_reg = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc)
+        {
+            system_config.quantum = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            system_config.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--quantum-report") == 0 && i + 1 < argc)
+        {
+            quantum_report = argv[++i];
+        }
+        else if (strcmp(argv[i], "--forwarding") == 0)
+        {
+            config.forwarding = TRUE;
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profile = argv[++i];
+            config.profile = TRUE;
+        }
+        else if (strcmp(argv[i], "--hugepages") == 0)
+        {
+            config.hugepages = TRUE;
+        }
+        else if (strcmp(argv[i], "--skip-idle") == 0)
+        {
+            config.skip_idle = TRUE;
+        }
+        else if (strcmp(argv[i], "--quiet") == 0)
+        {
+            quiet = TRUE;
+        }
+        else if (num_positional < 4)
+        {
+            positional[num_positional++] = argv[i];
+        }
+        else
+        {
+            num_positional = 0;
+            break;
+        }
+    }
+
+    int fastforward = (num_positional == 4 && strcmp(positional[1], "fastforward") == 0);
+    int multicore = (num_positional == 4 && strcmp(positional[1], "multicore") == 0);
+
+    if (num_positional != 3 && !fastforward && !multicore)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> simulate <cycles> [options]\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> fastforward <instructions> <cycles> [options]\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file>[,<input_file>...] multicore <cores> <cycles> [options]\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s batch <manifest> [--jobs <threads>] [--output <file>]\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Options: --checkpoint-restore <file>  resume from a checkpoint\n");
+        fprintf(stderr, "APEX_Help:          --checkpoint-save <file>     write a checkpoint at the end\n");
+        fprintf(stderr, "APEX_Help:          --btb <entries>              BTB size, 0 disables it (16)\n");
+        fprintf(stderr, "APEX_Help:          --btb-ways <ways>            BTB associativity (2)\n");
+        fprintf(stderr, "APEX_Help:          --icache <key=value,...>     L1 I-cache: size, line, ways, repl=lru|plru,\n");
+        fprintf(stderr, "APEX_Help:                                       hit, miss (off)\n");
+        fprintf(stderr, "APEX_Help:          --dcache <key=value,...>     L1 D-cache: size, line, ways, repl=lru|plru,\n");
+        fprintf(stderr, "APEX_Help:                                       write=wb|wt, hit, miss (off)\n");
+        fprintf(stderr, "APEX_Help:          --fu <class=cycles[:unpipelined],...>\n");
+        fprintf(stderr, "APEX_Help:                                       Execute latency of alu, lsu, mul, div (1)\n");
+        fprintf(stderr, "APEX_Help:          --parallel-units             units complete out of order\n");
+        fprintf(stderr, "APEX_Help:          --wb-arbiter <oldest|priority>\n");
+        fprintf(stderr, "APEX_Help:                                       finished unit that goes to Memory first (oldest)\n");
+        fprintf(stderr, "APEX_Help:          --width <1-4>                instructions issued per cycle (1)\n");
+        fprintf(stderr, "APEX_Help:          --engine <inorder|ooo>       timing model (inorder)\n");
+        fprintf(stderr, "APEX_Help:          --rob <entries>              OoO reorder buffer size (32)\n");
+        fprintf(stderr, "APEX_Help:          --iq <entries>               OoO issue queue size (16)\n");
+        fprintf(stderr, "APEX_Help:          --banks <banks>              multicore shared memory banks (1)\n");
+        fprintf(stderr, "APEX_Help:          --core-id-reg <register>     multicore register preset to the core number\n");
+        fprintf(stderr, "APEX_Help:          --quantum <cycles>           multicore cycles between thread barriers,\n");
+        fprintf(stderr, "APEX_Help:                                       1 steps the cores in lockstep (1)\n");
+        fprintf(stderr, "APEX_Help:          --threads <threads>          multicore host threads (one per core)\n");
+        fprintf(stderr, "APEX_Help:          --quantum-report <q,...>     multicore accuracy and speed of each quantum\n");
+        fprintf(stderr, "APEX_Help:          --forwarding                 bypass EX and MEM results to Decode/RF\n");
+        fprintf(stderr, "APEX_Help:          --profile <file>             write an annotated per-instruction profile\n");
+        fprintf(stderr, "APEX_Help:          --hugepages                  back data memory above 4096 with huge pages\n");
+        fprintf(stderr, "APEX_Help:          --skip-idle                  jump over idle cycles when not tracing\n");
+        fprintf(stderr, "APEX_Help:          --quiet                      no per-cycle trace, report host speed\n");
         exit(1);
     }
-    int cycles = atoi(argv[3]);
-    APEX_CPU* cpu = APEX_cpu_init(argv[1], argv[2], cycles);
+    int cycles = atoi(positional[(fastforward || multicore) ? 3 : 2]);
+    config.max_cycles = cycles;
+
+    if (multicore)
+    {
+        if (checkpoint_save || checkpoint_restore || profile)
+        {
+            fprintf(stderr, "APEX_Error: Checkpoints and profiles are not supported with multicore\n");
+            exit(1);
+        }
+
+        system_config.num_cores = atoi(positional[2]);
+        system_config.core = config;
+        return run_multicore(positional[0], &system_config, quiet, quantum_report);
+    }
+    APEX_CPU* cpu = APEX_cpu_create(positional[0], &config);
     if (!cpu)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
 
+    if (quiet)
+    {
+        cpu->config.trace = FALSE;
+    }
+    else if (ENABLE_DEBUG_MESSAGES)
+    {
+        APEX_cpu_print_code_memory(cpu);
+    }
+
+    if (checkpoint_restore)
+    {
+        if (APEX_cpu_checkpoint_restore(cpu, checkpoint_restore))
+        {
+            fprintf(stderr, "APEX_Error: Unable to restore checkpoint %s\n", checkpoint_restore);
+            exit(1);
+        }
+
+        /* <cycles> counts from the restored clock */
+        cpu->config.max_cycles = cpu->clock - 1 + cycles;
+        fprintf(stderr, "APEX_CPU: Restored checkpoint %s at cycle %d, pc(%d)\n",
+                checkpoint_restore, cpu->clock, cpu->pc);
+    }
+
+    if (fastforward)
+    {
+        int executed = APEX_cpu_fastforward(cpu, atoi(positional[2]));
+        if (executed < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to fast-forward a restored pipeline\n");
+            exit(1);
+        }
+        fprintf(stderr, "APEX_CPU: Fast-forwarded %d instructions, switching to pipeline at pc(%d)\n",
+                executed, cpu->pc);
+    }
+
+    struct timespec start, end;
+    int start_clock = cpu->clock;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
     APEX_cpu_run(cpu);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (quiet)
+    {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        int cycles_run = cpu->clock - start_clock;
+
+        fprintf(stderr, "APEX_CPU: Host time %.3f s, %.2f M cycles/s\n", seconds,
+                seconds > 0 ? cycles_run / seconds / 1e6 : 0.0);
+    }
+
+    if (profile && APEX_cpu_profile_write(cpu, positional[0], profile))
+    {
+        fprintf(stderr, "APEX_Error: Unable to write profile %s\n", profile);
+    }
+
+    if (checkpoint_save && APEX_cpu_checkpoint_save(cpu, checkpoint_save))
+    {
+        fprintf(stderr, "APEX_Error: Unable to save checkpoint %s\n", checkpoint_save);
+        APEX_cpu_stop(cpu);
+        exit(1);
+    }
+
     APEX_cpu_stop(cpu);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# checkpoint_roundtrip.sh
+# Saves a checkpoint of tests/stalls.asm at every cycle and checks that the
+# run resumed from it ends in the same state as the uninterrupted run. The
+# program stalls Decode/RF on the flags (CMP, BNZ) and on the unpipelined
+# divider (DIV, DIV), so checkpoints are taken in both kinds of stall.
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+SIM=${SIM:-./apex_sim_fast}
+PROG=tests/stalls.asm
+OPTS="--fu div=8:unpipelined"
+CKPT=${TMPDIR:-/tmp}/apex_roundtrip.$$.ckpt
+
+trap 'rm -f "$CKPT"' EXIT
+
+final_state()
+{
+    grep -E "REG\[|MEM\[|Flag|Simulation Complete" | md5sum
+}
+
+report=$($SIM $PROG simulate 100000 $OPTS </dev/null 2>&1)
+expected=$(echo "$report" | final_state)
+cycles=$(echo "$report" | sed -n 's/.*Simulation Complete, cycles = \([0-9]*\).*/\1/p')
+
+# Both stall kinds must occur, or the test does not cover them
+drf=$(echo "$report" | grep "^Decode/RF")
+flag_stalls=$(echo "$drf" | awk '{ print $5 }')
+structural_stalls=$(echo "$drf" | awk '{ print $6 }')
+if [ -z "$cycles" ] || [ "${flag_stalls:-0}" -eq 0 ] || [ "${structural_stalls:-0}" -eq 0 ]
+then
+    echo "FAIL: $PROG does not stall on the flags and the divider"
+    exit 1
+fi
+
+fail=0
+c=0
+while [ "$c" -le "$cycles" ]
+do
+    $SIM $PROG simulate $c $OPTS --checkpoint-save "$CKPT" </dev/null >/dev/null 2>&1
+    got=$($SIM $PROG simulate 100000 $OPTS --checkpoint-restore "$CKPT" </dev/null 2>&1 | final_state)
+    if [ "$got" != "$expected" ]
+    then
+        echo "FAIL: resuming from a checkpoint at cycle $c"
+        fail=1
+    fi
+    c=$((c + 1))
+done
+
+if [ "$fail" -eq 0 ]
+then
+    echo "PASS: checkpoint round trip before the first and after each of $cycles cycles"
+fi
+exit $fail
@@ -0,0 +1,8 @@
+MOVC R1,#0
+BZ #8
+MOVC R2,#99
+MOVC R3,#5
+AND R4,R3,R1
+BNZ #8
+MOVC R5,#7
+HALT
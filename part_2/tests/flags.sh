@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# flags.sh
+# Runs tests/flags.asm, in which a BZ follows a MOVC of zero and a BNZ an AND
+# with a zero result, on every engine. MOVC, AND, OR and EXOR set the flags
+# like the other arithmetic instructions, so the BZ skips R2 = 99 and the
+# BNZ falls through to R5 = 7.
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+SIM=${SIM:-./apex_sim_fast}
+PROG=tests/flags.asm
+
+fail=0
+for mode in "simulate 1000" "simulate 1000 --forwarding" "simulate 1000 --width 2" \
+            "simulate 1000 --engine ooo" "fastforward 100 1000"
+do
+    regs=$($SIM $PROG $mode </dev/null 2>&1 | grep -E "REG\[(2|5)\]" | awk '{ print $2 "=" $6 }' | tr '\n' ' ')
+    if [ "$regs" != "REG[2]=0 REG[5]=7 " ]
+    then
+        echo "FAIL: $mode: $regs"
+        fail=1
+    fi
+done
+
+if [ "$fail" -eq 0 ]
+then
+    echo "PASS: BZ and BNZ follow the flags set by MOVC and AND"
+fi
+exit $fail
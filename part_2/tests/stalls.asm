@@ -0,0 +1,9 @@
+MOVC R1,#5
+MOVC R2,#7
+MOVC R3,#0
+DIV R4,R1,R2
+DIV R5,R1,R2
+SUBL R1,R1,#1
+CMP R1,R3
+BNZ #-16
+HALT
@@ -0,0 +1,249 @@
+/*
+ * opcode_hash.c
+ * Generates the perfect hash of the mnemonics used by set_opcode_str() in
+ * file_parser.c, and checks that every mnemonic maps back to its opcode
+ *
+ * Usage:
+ *   opcode_hash <file_parser.c>          rewrites the generated block
+ *   opcode_hash --check <file_parser.c>  exits 1 if a mnemonic does not map
+ *                                        back to its opcode or the block is
+ *                                        not the generated one
+ *
+ * The mnemonics are taken from get_opcode_str(), so after adding an
+ * instruction to opcode_names run "make opcode-hash" and rebuild.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define BLOCK_BEGIN "/* Generated by tools/opcode_hash, run \"make opcode-hash\" after changing opcode_names */\n"
+#define BLOCK_END "/* End of generated code */\n"
+
+/* Candidate multipliers tried for each table size */
+#define MAX_TRIES (1 << 22)
+
+/* Same packing as set_opcode_str(): first character in the low byte */
+static uint64_t
+mnemonic_key(const char *name)
+{
+    uint64_t key = 0;
+
+    for (size_t i = 0; name[i] && i < 8; ++i)
+    {
+        key |= (uint64_t)(unsigned char)name[i] << (8 * i);
+    }
+    return key;
+}
+
+/* SplitMix64, so that every run finds the same multiplier */
+static uint64_t
+next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Finds the smallest table and the first odd multiplier giving every
+ * mnemonic a slot of its own. Returns -1 if there is none.
+ */
+static int
+search(int *bits, uint64_t *multiplier, int slots[256])
+{
+    uint64_t state = 0;
+
+    for (*bits = 1; *bits <= 8; ++*bits)
+    {
+        if ((1 << *bits) < NUM_OPCODES)
+        {
+            continue;
+        }
+
+        for (int t = 0; t < MAX_TRIES; ++t)
+        {
+            int used[256] = {0};
+            int opcode;
+
+            *multiplier = next_random(&state) | 1;
+            for (opcode = 0; opcode < NUM_OPCODES; ++opcode)
+            {
+                int slot = (mnemonic_key(get_opcode_str(opcode)) * *multiplier) >> (64 - *bits);
+
+                if (used[slot])
+                {
+                    break;
+                }
+                used[slot] = 1;
+                slots[slot] = opcode;
+            }
+
+            if (opcode == NUM_OPCODES)
+            {
+                for (int s = 0; s < (1 << *bits); ++s)
+                {
+                    if (!used[s])
+                    {
+                        slots[s] = -1;
+                    }
+                }
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Writes the generated block into 'out', which must hold 8192 bytes */
+static void
+generate(char *out, int bits, uint64_t multiplier, const int slots[256])
+{
+    int n = 0;
+
+    n += sprintf(out + n, "%s", BLOCK_BEGIN);
+    n += sprintf(out + n, "#define OPCODE_HASH_BITS %d\n", bits);
+    n += sprintf(out + n, "#define OPCODE_HASH_MULTIPLIER 0x%016llxull\n\n",
+                 (unsigned long long)multiplier);
+    n += sprintf(out + n, "/* Opcode of each slot, unused slots hold OPCODE_ADD and fail the compare */\n");
+    n += sprintf(out + n, "static const uint8_t opcode_slots[1 << OPCODE_HASH_BITS] = {\n");
+    for (int s = 0; s < (1 << bits); ++s)
+    {
+        if (slots[s] >= 0)
+        {
+            n += sprintf(out + n, "    [%d] = 0x%02x, /* %s */\n", s, slots[s],
+                         get_opcode_str(slots[s]));
+        }
+    }
+    n += sprintf(out + n, "};\n%s", BLOCK_END);
+}
+
+static char *
+read_file(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    char *text;
+    long len;
+
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    text = malloc(len + 1);
+    if (text && fread(text, 1, len, fp) != (size_t)len)
+    {
+        free(text);
+        text = NULL;
+    }
+    if (text)
+    {
+        text[len] = '\0';
+    }
+    fclose(fp);
+    return text;
+}
+
+int
+main(int argc, char const *argv[])
+{
+    const char *filename = argv[argc - 1];
+    int check = argc == 3 && strcmp(argv[1], "--check") == 0;
+    char block[8192];
+    int slots[256];
+    uint64_t multiplier;
+    char *text, *begin, *end;
+    int bits;
+    int fail = 0;
+
+    if (argc != 2 && !check)
+    {
+        fprintf(stderr, "Usage: %s [--check] <file_parser.c>\n", argv[0]);
+        return 2;
+    }
+
+    if (search(&bits, &multiplier, slots))
+    {
+        fprintf(stderr, "opcode_hash: no perfect hash found\n");
+        return 1;
+    }
+    generate(block, bits, multiplier, slots);
+
+    text = read_file(filename);
+    begin = text ? strstr(text, BLOCK_BEGIN) : NULL;
+    end = begin ? strstr(begin, BLOCK_END) : NULL;
+    if (!end)
+    {
+        fprintf(stderr, "opcode_hash: no generated block in %s\n", filename);
+        free(text);
+        return 1;
+    }
+    end += strlen(BLOCK_END);
+
+    if (check)
+    {
+        /* The table compiled into the parser must resolve every mnemonic */
+        for (int opcode = 0; opcode < NUM_OPCODES; ++opcode)
+        {
+            const char *name = get_opcode_str(opcode);
+
+            if (set_opcode_str(name, strlen(name)) != opcode)
+            {
+                fprintf(stderr, "opcode_hash: %s does not map back to opcode %d\n", name, opcode);
+                fail = 1;
+            }
+        }
+
+        if ((size_t)(end - begin) != strlen(block) || memcmp(begin, block, end - begin))
+        {
+            fprintf(stderr, "opcode_hash: the table in %s is out of date\n", filename);
+            fail = 1;
+        }
+
+        if (fail)
+        {
+            fprintf(stderr, "opcode_hash: run \"make opcode-hash\" and rebuild\n");
+        }
+        else
+        {
+            printf("PASS: every mnemonic maps back to its opcode\n");
+        }
+    }
+    else
+    {
+        FILE *fp = fopen(filename, "wb");
+
+        if (!fp)
+        {
+            fprintf(stderr, "opcode_hash: unable to write %s\n", filename);
+            fail = 1;
+        }
+        else if (fwrite(text, 1, begin - text, fp) != (size_t)(begin - text)
+                 || fputs(block, fp) == EOF || fputs(end, fp) == EOF)
+        {
+            fclose(fp);
+            fprintf(stderr, "opcode_hash: unable to write %s\n", filename);
+            fail = 1;
+        }
+        else if (fclose(fp))
+        {
+            fprintf(stderr, "opcode_hash: unable to write %s\n", filename);
+            fail = 1;
+        }
+    }
+
+    free(text);
+    return fail;
+}